@@ -21,6 +21,7 @@
 // Math constant and routines for OpenGL interop
 #include <glm/gtc/constants.hpp>
 
+#include "headless.h"
 #include "opengl_shader.h"
 
 template <typename T>
@@ -143,32 +144,43 @@ GLuint getTexure() {
     return texture;
 }
 
-int main(int, char **) {
-   // Use GLFW to create a simple window
-   glfwSetErrorCallback(glfw_error_callback);
-   if (!glfwInit())
-      return 1;
-
+int main(int argc, char **argv) {
+   HeadlessOptions headless = parse_headless_options(argc, argv);
 
    // GL 3.3 + GLSL 330
    const char *glsl_version = "#version 330";
-   glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-   glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-   glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-   //glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);            // 3.0+ only
-
-   // Create window with graphics context
-   GLFWwindow *window = glfwCreateWindow(1280, 720, "Dear ImGui - Conan", NULL, NULL);
-   if (window == NULL)
-      return 1;
-   glfwMakeContextCurrent(window);
-   glfwSwapInterval(1); // Enable vsync
-
-   // Initialize GLEW, i.e. fill all possible function pointers for current OpenGL context
-   if (glewInit() != GLEW_OK)
+   GLFWwindow *window = NULL;
+
+   if (headless.enabled)
+   {
+      if (!init_headless_context(headless.width, headless.height))
+         return 1;
+   }
+   else
    {
-      std::cerr << "Failed to initialize OpenGL loader!\n";
-      return 1;
+      // Use GLFW to create a simple window
+      glfwSetErrorCallback(glfw_error_callback);
+      if (!glfwInit())
+         return 1;
+
+      glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+      glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+      glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+      //glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);            // 3.0+ only
+
+      // Create window with graphics context
+      window = glfwCreateWindow(1280, 720, "Dear ImGui - Conan", NULL, NULL);
+      if (window == NULL)
+         return 1;
+      glfwMakeContextCurrent(window);
+      glfwSwapInterval(1); // Enable vsync
+
+      // Initialize GLEW, i.e. fill all possible function pointers for current OpenGL context
+      if (glewInit() != GLEW_OK)
+      {
+         std::cerr << "Failed to initialize OpenGL loader!\n";
+         return 1;
+      }
    }
 
    // create our geometries
@@ -178,28 +190,51 @@ int main(int, char **) {
    // init shader
    shader_t triangle_shader("assets/simple-shader.vs", "assets/simple-shader.fs");
 
-   // Setup GUI context
-   IMGUI_CHECKVERSION();
-   ImGui::CreateContext();
-   ImGuiIO &io = ImGui::GetIO();
-   ImGui_ImplGlfw_InitForOpenGL(window, true);
-   ImGui_ImplOpenGL3_Init(glsl_version);
-   ImGui::StyleColorsDark();
+   if (!headless.enabled)
+   {
+      // Setup GUI context
+      IMGUI_CHECKVERSION();
+      ImGui::CreateContext();
+      ImGuiIO &io = ImGui::GetIO();
+      ImGui_ImplGlfw_InitForOpenGL(window, true);
+      ImGui_ImplOpenGL3_Init(glsl_version);
+      ImGui::StyleColorsDark();
+   }
 
    auto const start_time = std::chrono::steady_clock::now();
 
 
-   glfwSetScrollCallback(window, &scroll_callback);
-   glfwSetCursorPosCallback(window, &mouse_callback);
+   if (!headless.enabled)
+   {
+      glfwSetScrollCallback(window, &scroll_callback);
+      glfwSetCursorPosCallback(window, &mouse_callback);
+   }
 
    GLuint texture = getTexure();
 
-   while (!glfwWindowShouldClose(window)) {
+   static float color[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+   static float c[] = { -0.8f, 0.156f };
+   static int iterations = 15;
 
-       // Get windows size
-       glfwGetFramebufferSize(window, &display_w, &display_h);
+   FrameTimes frame_times(headless.enabled ? headless.frames : 0);
+   int frame_index = 0;
 
-       glfwPollEvents();
+   while (headless.enabled ? frame_index < headless.frames : !glfwWindowShouldClose(window)) {
+       frame_times.begin_frame();
+
+       if (headless.enabled) {
+           display_w = headless.width;
+           display_h = headless.height;
+
+           // fixed camera path: zoom from the whole set to the maximum zoom
+           zoom = ZOOM_MIN * powf(ZOOM_MAX / ZOOM_MIN, float(frame_index) / headless.frames);
+           crop_translation();
+       } else {
+           // Get windows size
+           glfwGetFramebufferSize(window, &display_w, &display_h);
+
+           glfwPollEvents();
+       }
 
        // Set viewport to fill the whole window area
        glViewport(0, 0, display_w, display_h);
@@ -208,23 +243,22 @@ int main(int, char **) {
        glClearColor(0.30f, 0.55f, 0.60f, 1.00f);
        glClear(GL_COLOR_BUFFER_BIT);
 
-       // Gui start new frame
-       ImGui_ImplOpenGL3_NewFrame();
-       ImGui_ImplGlfw_NewFrame();
-       ImGui::NewFrame();
+       if (!headless.enabled) {
+           // Gui start new frame
+           ImGui_ImplOpenGL3_NewFrame();
+           ImGui_ImplGlfw_NewFrame();
+           ImGui::NewFrame();
 
 
-       // GUI
-       ImGui::Begin("Triangle Position/Color");
-       ImGui::SliderFloat("zoom", &zoom, ZOOM_MIN, ZOOM_MAX);
-       ImGui::SliderFloat2("position", translation, -1.0, 1.0);
-       static float color[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
-       ImGui::ColorEdit3("color", color);
-       static float c[] = { -0.8f, 0.156f };
-       ImGui::SliderFloat2("c", c, -MAXC_C_ABS, MAXC_C_ABS);
-       static int iterations = 15;
-       ImGui::SliderInt("iterations", &iterations, 1, 150);
-       ImGui::End();
+           // GUI
+           ImGui::Begin("Triangle Position/Color");
+           ImGui::SliderFloat("zoom", &zoom, ZOOM_MIN, ZOOM_MAX);
+           ImGui::SliderFloat2("position", translation, -1.0, 1.0);
+           ImGui::ColorEdit3("color", color);
+           ImGui::SliderFloat2("c", c, -MAXC_C_ABS, MAXC_C_ABS);
+           ImGui::SliderInt("iterations", &iterations, 1, 150);
+           ImGui::End();
+       }
 
        // Pass the parameters to the shader as uniforms
        triangle_shader.set_uniform("u_zoom", zoom);
@@ -232,7 +266,9 @@ int main(int, char **) {
        triangle_shader.set_uniform("u_iterations", iterations);
        triangle_shader.set_uniform("u_translation", translation[0], translation[1]);
        triangle_shader.set_uniform("u_c", c[0], c[1]);
-       float const time_from_start = (float)(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start_time).count() / 1000.0);
+       float const time_from_start = headless.enabled
+           ? frame_index / 60.0f
+           : (float)(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start_time).count() / 1000.0);
        triangle_shader.set_uniform("u_time", time_from_start);
        triangle_shader.set_uniform("u_color", color[0], color[1], color[2]);
        triangle_shader.set_uniform("u_tex", int(0));
@@ -250,6 +286,12 @@ int main(int, char **) {
        glDrawElements(GL_TRIANGLES, 3, GL_UNSIGNED_INT, 0);
        glBindVertexArray(0);
 
+       if (headless.enabled) {
+           frame_times.end_frame();
+           frame_index++;
+           continue;
+       }
+
        // Generate gui render commands
        ImGui::Render();
 
@@ -260,6 +302,13 @@ int main(int, char **) {
        glfwSwapBuffers(window);
    }
 
+   if (headless.enabled)
+   {
+      frame_times.write_csv(headless.csv_filename);
+      destroy_headless_context();
+      return 0;
+   }
+
    // Cleanup
    ImGui_ImplOpenGL3_Shutdown();
    ImGui_ImplGlfw_Shutdown();
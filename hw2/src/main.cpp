@@ -27,6 +27,7 @@
 
 #include "opengl_shader.h"
 #include "glconfig.h"
+#include "headless.h"
 
 // STB, load images
 #define STB_IMAGE_IMPLEMENTATION
@@ -232,8 +233,16 @@ void mouse_callback(GLFWwindow *window, double xpos, double ypos) {
     cursor_position[1] = ypos;
 }
 
-int main(int, char **) {
-    GLFWwindow *window = init_window();
+int main(int argc, char **argv) {
+    HeadlessOptions headless = parse_headless_options(argc, argv);
+
+    GLFWwindow *window = NULL;
+    if (headless.enabled) {
+        if (!init_headless_context(headless.width, headless.height))
+            return 1;
+    } else {
+        window = init_window();
+    }
 
     tinyobj::attrib_t attrib;
     std::vector<tinyobj::shape_t> shapes;
@@ -263,20 +272,42 @@ int main(int, char **) {
 
     std::cerr << "shaders done\n";
 
-    setup_imgui(window);
+    if (!headless.enabled) {
+        setup_imgui(window);
 
-    glfwSetScrollCallback(window, &scroll_callback);
-    glfwSetCursorPosCallback(window, &mouse_callback);
+        glfwSetScrollCallback(window, &scroll_callback);
+        glfwSetCursorPosCallback(window, &mouse_callback);
+    }
 
     auto const start_time = std::chrono::steady_clock::now();
 
-    while (!glfwWindowShouldClose(window)) {
+    // controls
+    static float fovy = 90;
+    static float prism_n = 0.8;
+    static float texture_a = 0.2;
+    static float color[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+    static bool texture_gamma_correction = true;
+    static bool blend_gamma_correction = true;
 
-        glfwPollEvents();
+    FrameTimes frame_times(headless.enabled ? headless.frames : 0);
+    int frame_index = 0;
+
+    while (headless.enabled ? frame_index < headless.frames : !glfwWindowShouldClose(window)) {
+        frame_times.begin_frame();
 
         // Get windows size
         int display_w, display_h;
-        glfwGetFramebufferSize(window, &display_w, &display_h);
+        if (headless.enabled) {
+            display_w = headless.width;
+            display_h = headless.height;
+
+            // fixed camera path: one full turn around the object
+            rotation = 2.0f * frame_index / headless.frames;
+            pitch = 0.1;
+        } else {
+            glfwPollEvents();
+            glfwGetFramebufferSize(window, &display_w, &display_h);
+        }
 
         // Set viewport to fill the whole window area
         glViewport(0, 0, display_w, display_h);
@@ -289,33 +320,29 @@ int main(int, char **) {
         glEnable(GL_DEPTH_TEST);
         glDepthFunc(GL_LEQUAL);
 
-        // Gui start new frame
         auto const frame_start_time = std::chrono::steady_clock::now();
-        ImGui_ImplOpenGL3_NewFrame();
-        ImGui_ImplGlfw_NewFrame();
-        ImGui::NewFrame();
+        if (!headless.enabled) {
+            // Gui start new frame
+            ImGui_ImplOpenGL3_NewFrame();
+            ImGui_ImplGlfw_NewFrame();
+            ImGui::NewFrame();
 
-        // GUI
-        ImGui::Begin("Triangle Position/Color");
-        static float fovy = 90;
-        ImGui::SliderFloat("fovy", &fovy, 10, 180);
+            // GUI
+            ImGui::Begin("Triangle Position/Color");
+            ImGui::SliderFloat("fovy", &fovy, 10, 180);
 
-        static float prism_n = 0.8;
-        ImGui::SliderFloat("prism_n", &prism_n, 0.1, 1);
+            ImGui::SliderFloat("prism_n", &prism_n, 0.1, 1);
 
-        static float texture_a = 0.2;
-        ImGui::SliderFloat("texture alpha", &texture_a, 0, 1);
+            ImGui::SliderFloat("texture alpha", &texture_a, 0, 1);
 
-        static float color[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
-        ImGui::ColorEdit3("color", color);
+            ImGui::ColorEdit3("color", color);
 
-        static bool texture_gamma_correction = true;
-        ImGui::Checkbox("texture gamma correction", &texture_gamma_correction);
+            ImGui::Checkbox("texture gamma correction", &texture_gamma_correction);
 
-        static bool blend_gamma_correction = true;
-        ImGui::Checkbox("blend gamma correction", &blend_gamma_correction);
+            ImGui::Checkbox("blend gamma correction", &blend_gamma_correction);
 
-        ImGui::End();
+            ImGui::End();
+        }
 
         // Pass the parameters to the shader as uniforms
         float const time_from_start = (float)(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start_time).count() / 1000.0);
@@ -396,6 +423,12 @@ int main(int, char **) {
             mesh.draw();
         }
 
+        if (headless.enabled) {
+            frame_times.end_frame();
+            frame_index++;
+            continue;
+        }
+
         // Generate gui render commands
         ImGui::Render();
 
@@ -408,6 +441,12 @@ int main(int, char **) {
         wait_fps_cap(frame_start_time);
     }
 
+    if (headless.enabled) {
+        frame_times.write_csv(headless.csv_filename);
+        destroy_headless_context();
+        return 0;
+    }
+
     // Cleanup
     ImGui_ImplOpenGL3_Shutdown();
     ImGui_ImplGlfw_Shutdown();
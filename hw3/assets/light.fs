@@ -1,48 +1,115 @@
 
+// keep in sync with uniform_blocks.h
 #define DIR_LIGHT_SOURCES 1
-
-uniform vec3 background_light;
-
-uniform int dl_num;
-uniform vec3 dl_dir[DIR_LIGHT_SOURCES];
-uniform vec3 dl_light[DIR_LIGHT_SOURCES];
-uniform sampler2D dl_depth[DIR_LIGHT_SOURCES];
-uniform mat4 dl_vp[DIR_LIGHT_SOURCES];
-
 #define PD_LIGHT_SOURCES 1
+#define SHADOW_CASCADES 4
+
+// uploaded once per frame, shared by all programs
+layout (std140) uniform Lights {
+    vec3 background_light;
+    int dl_num;
+    int pd_num;
+
+    vec3 dl_dir[DIR_LIGHT_SOURCES];
+    vec3 dl_light[DIR_LIGHT_SOURCES];
+    mat4 dl_vp[DIR_LIGHT_SOURCES * SHADOW_CASCADES];
+
+    vec3 pd_dir[PD_LIGHT_SOURCES];
+    vec3 pd_pos[PD_LIGHT_SOURCES];
+    vec3 pd_light[PD_LIGHT_SOURCES];
+    float pd_angle[PD_LIGHT_SOURCES];
+    mat4 pd_vp[PD_LIGHT_SOURCES];
+};
+
+// light counts and shadows are permutation defines, programs built without them loop up to the
+// counts in the block and sample the shadow maps
+#ifndef DL_COUNT
+#define DL_COUNT dl_num
+#endif
+#ifndef PD_COUNT
+#define PD_COUNT pd_num
+#endif
+#ifndef NO_SHADOWS
+#define SHADOWS
+#endif
+
+// samplers can not live in a block
+// depth compare samplers, one layer a cascade
+uniform sampler2DArrayShadow dl_depth[DIR_LIGHT_SOURCES];
+uniform sampler2DShadow pd_depth[PD_LIGHT_SOURCES];
+
+// PCF kernel, a permutation define. Every tap is one hardware compare filtered over 2x2 texels, offsets are
+// in the unit circle and scaled by PCF_RADIUS texels
+#if defined(PCF_ROTATED_GRID)
+#define PCF_TAPS 4
+#define PCF_RADIUS 1.0
+const vec2 pcf_offsets[PCF_TAPS] = vec2[](
+    vec2(-0.25, -0.75), vec2(0.75, -0.25), vec2(0.25, 0.75), vec2(-0.75, 0.25)
+);
+#elif defined(PCF_POISSON)
+#define PCF_TAPS 12
+#define PCF_RADIUS 2.0
+const vec2 pcf_offsets[PCF_TAPS] = vec2[](
+    vec2(-0.326212, -0.405810), vec2(-0.840144, -0.073580), vec2(-0.695914, 0.457137), vec2(-0.203345, 0.620716),
+    vec2(0.962340, -0.194983), vec2(0.473434, -0.480026), vec2(0.519456, 0.767022), vec2(0.185461, -0.893124),
+    vec2(0.507431, 0.064425), vec2(0.896420, 0.412458), vec2(-0.321940, -0.932615), vec2(-0.791559, -0.597710)
+);
+#endif
+
+// lit fraction around scoord.xy, scoord.z is compared. The depth bias is the casters' polygon offset
+float pcf_shadow(sampler2DArrayShadow depth, vec3 scoord, float layer) {
+#ifdef PCF_TAPS
+    vec2 texel = PCF_RADIUS / vec2(textureSize(depth, 0).xy);
+    float lit = 0.0;
+    for (int i = 0; i < PCF_TAPS; i++) {
+        lit += texture(depth, vec4(scoord.xy + pcf_offsets[i] * texel, layer, scoord.z));
+    }
+    return lit / PCF_TAPS;
+#else
+    return texture(depth, vec4(scoord.xy, layer, scoord.z));
+#endif
+}
 
-uniform int pd_num;
-uniform vec3 pd_dir[PD_LIGHT_SOURCES];
-uniform vec3 pd_pos[PD_LIGHT_SOURCES];
-uniform vec3 pd_light[PD_LIGHT_SOURCES];
-uniform float pd_angle[PD_LIGHT_SOURCES];
-uniform sampler2D pd_depth[DIR_LIGHT_SOURCES];
-uniform mat4 pd_vp[DIR_LIGHT_SOURCES];
+float pcf_shadow(sampler2DShadow depth, vec3 scoord) {
+#ifdef PCF_TAPS
+    vec2 texel = PCF_RADIUS / vec2(textureSize(depth, 0));
+    float lit = 0.0;
+    for (int i = 0; i < PCF_TAPS; i++) {
+        lit += texture(depth, vec3(scoord.xy + pcf_offsets[i] * texel, scoord.z));
+    }
+    return lit / PCF_TAPS;
+#else
+    return texture(depth, scoord);
+#endif
+}
 
 float get_shadow_dl(vec3 obj_pos, int dl_i) {
-    vec4 scoord = dl_vp[dl_i] * vec4(obj_pos, 1);
-    scoord /= scoord.w;
-    scoord = scoord / 2 + 0.5;
-    float shadow_depth = texture(dl_depth[dl_i], scoord.xy).x;
-
-    // return scoord.z - shadow_depth + 1e-3;
-    if (scoord.z - 1e-3 >= shadow_depth)
-        return 0;
-    else
-        return 1;
+#ifdef SHADOWS
+    // cascades are ordered near to far, the first one covering the point has the finest texels
+    for (int c = 0; c < SHADOW_CASCADES; c++) {
+        vec4 scoord = dl_vp[dl_i * SHADOW_CASCADES + c] * vec4(obj_pos, 1);
+        scoord /= scoord.w;
+        if (any(greaterThan(abs(scoord.xyz), vec3(1))))
+            continue;
+        scoord = scoord / 2 + 0.5;
+        return pcf_shadow(dl_depth[dl_i], scoord.xyz, c);
+    }
+    // past the last cascade
+    return 1.0;
+#else
+    return 1;
+#endif
 }
 
 float get_shadow_pd(vec3 obj_pos, int pd_i) {
+#ifdef SHADOWS
     vec4 scoord = pd_vp[pd_i] * vec4(obj_pos, 1);
     scoord /= scoord.w;
     scoord = scoord / 2 + 0.5;
-    float shadow_depth = texture(pd_depth[pd_i], scoord.xy).x;
-
-    // return scoord.z - shadow_depth + 1e-3;
-    if (scoord.z - 1e-2 >= shadow_depth)
-        return 0;
-    else
-        return 1;
+    return pcf_shadow(pd_depth[pd_i], scoord.xyz);
+#else
+    return 1;
+#endif
 }
 
 vec3 light_to_color(vec3 light) {
@@ -55,7 +122,7 @@ vec3 get_light(vec3 obj_position, vec3 camera_position, vec3 normal, vec3 textur
 
     vec3 res_light = background_light;
 
-    for (int dl_i = 0; dl_i < dl_num; dl_i++) {
+    for (int dl_i = 0; dl_i < DL_COUNT; dl_i++) {
         vec3 light_e = dl_light[dl_i] * max(0, dot(dl_dir[dl_i], normal));
         light_e = mix(
             light_e,
@@ -65,7 +132,7 @@ vec3 get_light(vec3 obj_position, vec3 camera_position, vec3 normal, vec3 textur
         res_light += light_e * get_shadow_dl(obj_position, dl_i);
     }
 
-    for (int pd_i = 0; pd_i < pd_num; pd_i++) {
+    for (int pd_i = 0; pd_i < PD_COUNT; pd_i++) {
         vec3 source_obj = obj_position - pd_pos[pd_i];
         float pd_dist = length(source_obj);
         source_obj /= pd_dist;
@@ -95,7 +162,7 @@ vec4 texture_cubemap(samplerCube cube, vec3 dir) {
     const float FULL_COLOR = 0.995;
     const float NO_COLOR = 0.993;
 
-    for (int i = 0; i < dl_num; i++) {
+    for (int i = 0; i < DL_COUNT; i++) {
         float dot_v = dot(dl_dir[i], dir);
         if (dot_v > FULL_COLOR) {
             res = vec4(1, 1, 1, 1);
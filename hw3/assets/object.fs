@@ -1,6 +1,6 @@
 #version 330 core
 
-#myinclude_light
+#include "light.fs"
 
 out vec4 o_frag_color;
 
@@ -24,10 +24,9 @@ uniform float u_prism_n1;
 uniform vec3 u_color0;
 uniform vec3 u_color1;
 
-uniform vec3 u_cam;
+#include "camera.fs"
 
-uniform bool u_tex_gamma_correct;
-uniform bool u_blend_gamma_correct;
+// TEX_GAMMA_CORRECT and BLEND_GAMMA_CORRECT are permutation defines
 
 const float GAMMA = 2.2;
 const float UNGAMMA = 1 / GAMMA;
@@ -78,21 +77,21 @@ vec3 color(sampler2D u_tex, float u_texture_a, float u_prism_n)
     // tex = ungamma(tex);
     tex = get_light(v_out.position, u_cam, v_out.normal, tex, 0.8);
 
-    if (u_tex_gamma_correct) {
-        tex = gamma(tex);
-    }
+#ifdef TEX_GAMMA_CORRECT
+    tex = gamma(tex);
+#endif
 
     vec3 color_out;
 
-    if (u_blend_gamma_correct) {
-        mirror = ungamma(mirror);
-        prism = ungamma(prism);
-        tex = ungamma(tex);
-    }
+#ifdef BLEND_GAMMA_CORRECT
+    mirror = ungamma(mirror);
+    prism = ungamma(prism);
+    tex = ungamma(tex);
+#endif
     color_out = (mirror * r_ref + prism * r_prism) * (1 - u_texture_a) + tex * u_texture_a;
-    if (u_blend_gamma_correct) {
-        color_out = gamma(color_out);
-    }
+#ifdef BLEND_GAMMA_CORRECT
+    color_out = gamma(color_out);
+#endif
     
 
     return color_out;
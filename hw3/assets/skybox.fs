@@ -1,6 +1,6 @@
 #version 330 core
 
-#myinclude_light
+#include "light.fs"
 
 out vec4 o_frag_color;
 
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "glconfig.h"
+#include "texture_residency.h"
+
+// Loads textures and OBJ models in the background. Files are mapped from their cache, or baked into it first,
+// and packed on worker threads, the GL uploads run on the GL thread in update(), a few per frame.
+// Every handle is usable right away: textures are a 1x1 grey placeholder until their image is uploaded
+// in place, objects are an empty mesh list until their meshes are appended. Textures are shared through
+// a TextureResidency, a file requested again while still resident is not loaded twice.
+// All public methods are called from the GL thread
+class AssetManager {
+  public:
+    // 0 threads leaves one core to the GL thread
+    AssetManager(size_t thread_count = 0);
+    ~AssetManager();
+
+    // the same canonical filename, flip and linear returns the same texture. Linear for data such as masks,
+    // its mips are not gamma corrected
+    TextureRef texture(const std::string& filename, bool flip_vertically = true, bool linear = false);
+    // +x, -x, +y, -y, +z, -z faces, not flipped
+    TextureRef cubemap(const std::vector<std::string>& filenames);
+    // OBJ through the mesh cache, with its textures loaded by texture(). The reference stays valid
+    std::vector<Mesh>& object(const std::string& path, const std::string& filename);
+
+    // uploads finished loads until budget_ms passed, at least one if any is ready, then evicts textures over
+    // the texture budget
+    void update(double budget_ms);
+    // blocks until everything requested so far is uploaded, e.g. before a benchmark
+    void finish();
+    // requested and not uploaded yet
+    size_t pending() const;
+    // budget and memory accounting of the loaded textures
+    TextureResidency& textures() { return residency; }
+
+  private:
+    // a worker job returns the GL part, which runs in update()
+    typedef std::function<void()> Upload;
+    typedef std::function<Upload()> Job;
+
+    void enqueue(Job job);
+    void worker();
+    bool run_upload(bool wait);
+    // one glTexImage2D of RGB8 pixels
+    struct PixelUpload {
+        GLenum target;
+        GLint level;
+        int width;
+        int height;
+        const unsigned char* pixels;
+    };
+    // returns the estimated size in video memory
+    size_t upload_pixels(const std::vector<PixelUpload>& images);
+
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable job_added;
+    std::condition_variable upload_added;
+    std::deque<Job> jobs;
+    std::deque<Upload> uploads;
+    bool stopping = false;
+
+    size_t pending_ = 0;
+    TextureResidency residency;
+    std::list<std::vector<Mesh>> objects;
+    // pixel unpack buffer, orphaned for every upload so the copy into the texture does not stall
+    GLuint upload_buffer = 0;
+};
@@ -0,0 +1,23 @@
+#include "frustum.h"
+
+Frustum::Frustum(const glm::mat4& mvp) {
+    // -w <= x, y, z <= w in clip space, rows of the column major matrix
+    glm::vec4 row[4];
+    for (int i = 0; i < 4; i++) {
+        row[i] = glm::vec4(mvp[0][i], mvp[1][i], mvp[2][i], mvp[3][i]);
+    }
+    for (int i = 0; i < 3; i++) {
+        planes[2 * i] = row[3] + row[i];
+        planes[2 * i + 1] = row[3] - row[i];
+    }
+}
+
+bool Frustum::intersects(const glm::vec3& box_min, const glm::vec3& box_max) const {
+    for (const glm::vec4& plane : planes) {
+        // the corner furthest along the plane's normal
+        glm::vec3 corner(plane.x >= 0 ? box_max.x : box_min.x, plane.y >= 0 ? box_max.y : box_min.y, plane.z >= 0 ? box_max.z : box_min.z);
+        if (plane.x * corner.x + plane.y * corner.y + plane.z * corner.z + plane.w < 0)
+            return false;
+    }
+    return true;
+}
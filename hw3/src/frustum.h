@@ -0,0 +1,16 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+// Clip volume of a projection matrix as six planes, inside is dot(plane, vec4(p, 1)) >= 0. Built from a model
+// view projection matrix the planes are in the model's space, so object space boxes are tested as they are
+class Frustum {
+  public:
+    explicit Frustum(const glm::mat4& mvp);
+
+    // false only if the box is entirely outside one plane, boxes near an edge of the volume may pass
+    bool intersects(const glm::vec3& box_min, const glm::vec3& box_max) const;
+
+  private:
+    glm::vec4 planes[6];
+};
@@ -0,0 +1,171 @@
+#include "gl_state.h"
+
+#include <map>
+
+namespace {
+// units tracked, the scenes use up to 12
+const GLuint UNIT_COUNT = 16;
+const GLuint UNKNOWN = GLuint(-1);
+
+struct Unit {
+    GLuint texture_2d = UNKNOWN;
+    GLuint texture_cube = UNKNOWN;
+    GLuint texture_2d_array = UNKNOWN;
+    GLuint sampler = UNKNOWN;
+};
+
+struct State {
+    GLuint program = UNKNOWN;
+    GLuint vao = UNKNOWN;
+    GLuint active_unit = UNKNOWN;
+    Unit units[UNIT_COUNT];
+    GLuint framebuffer = UNKNOWN;
+    bool viewport_known = false;
+    GLint viewport[4] = {};
+    std::map<GLenum, bool> enabled;
+    GLenum blend_source = UNKNOWN;
+    GLenum blend_destination = UNKNOWN;
+    GLenum depth_func = UNKNOWN;
+    int depth_mask = -1;
+    int color_mask = -1;
+};
+
+State state;
+
+// true if the call has to be issued, cached is then updated to value
+template <typename T>
+bool change(T& cached, T value) {
+    if (cached == value) {
+        gl_state::stats.skipped++;
+        return false;
+    }
+    cached = value;
+    gl_state::stats.issued++;
+    return true;
+}
+
+void active_texture(GLuint unit) {
+    if (change(state.active_unit, unit))
+        glActiveTexture(GL_TEXTURE0 + unit);
+}
+}
+
+namespace gl_state {
+gl_state_stats stats;
+
+void use_program(GLuint program) {
+    if (change(state.program, program))
+        glUseProgram(program);
+}
+
+void bind_vertex_array(GLuint vao) {
+    if (change(state.vao, vao))
+        glBindVertexArray(vao);
+}
+
+void bind_texture(GLuint unit, GLenum target, GLuint texture) {
+    active_texture(unit);
+    GLuint* cached = nullptr;
+    if (unit < UNIT_COUNT && target == GL_TEXTURE_2D)
+        cached = &state.units[unit].texture_2d;
+    else if (unit < UNIT_COUNT && target == GL_TEXTURE_CUBE_MAP)
+        cached = &state.units[unit].texture_cube;
+    else if (unit < UNIT_COUNT && target == GL_TEXTURE_2D_ARRAY)
+        cached = &state.units[unit].texture_2d_array;
+    if (cached == nullptr) {
+        stats.issued++;
+        glBindTexture(target, texture);
+    } else if (change(*cached, texture)) {
+        glBindTexture(target, texture);
+    }
+}
+
+void bind_sampler(GLuint unit, GLuint sampler) {
+    // glBindSampler takes the unit, no glActiveTexture needed
+    if (unit >= UNIT_COUNT) {
+        stats.issued++;
+        glBindSampler(unit, sampler);
+    } else if (change(state.units[unit].sampler, sampler)) {
+        glBindSampler(unit, sampler);
+    }
+}
+
+void bind_framebuffer(GLuint framebuffer) {
+    if (change(state.framebuffer, framebuffer))
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+}
+
+void viewport(GLint x, GLint y, GLsizei width, GLsizei height) {
+    if (state.viewport_known && state.viewport[0] == x && state.viewport[1] == y && state.viewport[2] == width && state.viewport[3] == height) {
+        stats.skipped++;
+        return;
+    }
+    state.viewport_known = true;
+    state.viewport[0] = x;
+    state.viewport[1] = y;
+    state.viewport[2] = width;
+    state.viewport[3] = height;
+    stats.issued++;
+    glViewport(x, y, width, height);
+}
+
+void set_enabled(GLenum capability, bool enabled) {
+    auto it = state.enabled.find(capability);
+    if (it != state.enabled.end() && it->second == enabled) {
+        stats.skipped++;
+        return;
+    }
+    state.enabled[capability] = enabled;
+    stats.issued++;
+    if (enabled)
+        glEnable(capability);
+    else
+        glDisable(capability);
+}
+
+void blend_func(GLenum source, GLenum destination) {
+    if (state.blend_source == source && state.blend_destination == destination) {
+        stats.skipped++;
+        return;
+    }
+    state.blend_source = source;
+    state.blend_destination = destination;
+    stats.issued++;
+    glBlendFunc(source, destination);
+}
+
+void depth_func(GLenum func) {
+    if (change(state.depth_func, func))
+        glDepthFunc(func);
+}
+
+void depth_mask(bool write) {
+    if (change(state.depth_mask, int(write)))
+        glDepthMask(write);
+}
+
+void color_mask(bool write) {
+    if (change(state.color_mask, int(write)))
+        glColorMask(write, write, write, write);
+}
+
+void forget_texture(GLuint texture) {
+    for (Unit& unit : state.units) {
+        if (unit.texture_2d == texture)
+            unit.texture_2d = UNKNOWN;
+        if (unit.texture_cube == texture)
+            unit.texture_cube = UNKNOWN;
+        if (unit.texture_2d_array == texture)
+            unit.texture_2d_array = UNKNOWN;
+    }
+}
+
+void forget_program(GLuint program) {
+    if (state.program == program)
+        state.program = UNKNOWN;
+}
+
+void invalidate() {
+    state = State();
+}
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstddef>
+
+#include <GL/glew.h>
+
+// Calls through gl_state since the last reset, skipped ones would have set the value already current
+struct gl_state_stats {
+    size_t issued = 0;
+    size_t skipped = 0;
+};
+
+// Shadow copy of the GL state the render loops change: program, vertex array, textures and samplers per
+// unit, draw framebuffer, viewport, blend and depth state. Each setter skips the GL call when the value is
+// already current. Code changing this state directly (imgui, setup code) must be followed by invalidate().
+// GL thread only
+namespace gl_state {
+extern gl_state_stats stats;
+
+void use_program(GLuint program);
+void bind_vertex_array(GLuint vao);
+// GL_TEXTURE_2D, GL_TEXTURE_CUBE_MAP and GL_TEXTURE_2D_ARRAY are tracked per unit, other targets always issue
+// the call.
+// Leaves unit active, so glTexParameteri or glTexImage2D right after apply to texture
+void bind_texture(GLuint unit, GLenum target, GLuint texture);
+void bind_sampler(GLuint unit, GLuint sampler);
+// GL_FRAMEBUFFER, draw and read
+void bind_framebuffer(GLuint framebuffer);
+void viewport(GLint x, GLint y, GLsizei width, GLsizei height);
+// glEnable / glDisable
+void set_enabled(GLenum capability, bool enabled);
+void blend_func(GLenum source, GLenum destination);
+void depth_func(GLenum func);
+void depth_mask(bool write);
+void color_mask(bool write);
+
+// before a deleted name can be handed out again, so a new object with it is not taken as bound
+void forget_texture(GLuint texture);
+void forget_program(GLuint program);
+// everything unknown, the next setters issue their calls
+void invalidate();
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include <GL/glew.h>
+
+// `--headless --frames N [--csv file] [--size W H]`
+struct HeadlessOptions {
+    bool enabled = false;
+    int frames = 300;
+    int width = 1280;
+    int height = 720;
+    std::string csv_filename = "frame_times.csv";
+};
+
+HeadlessOptions parse_headless_options(int argc, char** argv);
+
+// Offscreen GL 3.3 core context on an EGL pbuffer, framebuffer 0 is the pbuffer
+bool init_headless_context(int width, int height);
+void destroy_headless_context();
+
+// CPU time of every frame and GPU time between GL_TIMESTAMP queries at its ends.
+// Timestamps are used instead of GL_TIME_ELAPSED so the frame can contain elapsed-time queries itself
+class FrameTimes {
+  public:
+    explicit FrameTimes(size_t frames);
+    ~FrameTimes();
+
+    void begin_frame();
+    void end_frame();
+
+    // blocks until all GPU results are available
+    void write_csv(const std::string& filename);
+
+  private:
+    std::vector<GLuint> queries;
+    std::vector<double> cpu_ms;
+
+    std::chrono::steady_clock::time_point frame_start;
+};
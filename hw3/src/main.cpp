@@ -26,19 +26,31 @@
 
 
 #include "opengl_shader.h"
+#include "asset_manager.h"
+#include "frustum.h"
+#include "gl_state.h"
 #include "glconfig.h"
+#include "headless.h"
+#include "profiler.h"
+#include "sampler_cache.h"
+#include "shader_permutations.h"
+#include "shader_watcher.h"
+#include "uniform_blocks.h"
 
 // STB, load images
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb_image.h>
-// obj loader implementation
-#define TINYOBJLOADER_IMPLEMENTATION
-#include "tiny_obj_loader.h"
 
 #include "movement.h"
 
 const double FPS_CAP = 60;
 const double FRAME_TIME_NSECONDS = 1e9 / FPS_CAP;
+// time for GL uploads of streamed assets each frame
+const double ASSET_UPLOAD_BUDGET_MS = 4;
+// estimated video memory of loaded textures before released ones are deleted
+const size_t TEXTURE_BUDGET_BYTES = size_t(256) << 20;
+
+const SamplerState SKYBOX_SAMPLER = { GL_LINEAR, GL_LINEAR, GL_CLAMP_TO_EDGE, GL_NONE, GL_LEQUAL, { 0, 0, 0, 0 } };
 
 void wait_fps_cap(std::chrono::steady_clock::time_point start_time) {
     using namespace std::chrono;
@@ -101,131 +113,35 @@ void create_skybox(GLuint &vbo, GLuint &vao, GLuint &ebo) {
     glBindVertexArray(0);
 }
 
-/// @returns number of triangles
-std::vector<Mesh> create_object
-    ( const tinyobj::attrib_t &attrib
-    , const std::vector<tinyobj::shape_t> &shapes
-    , const std::vector<Material> &materials) {
-
-    std::vector<Mesh> meshes;
-    meshes.reserve(shapes.size());
-
-    for (const tinyobj::shape_t& shape : shapes) {
-        size_t vertex_count = 0;
-        size_t face_count = 0;
-        std::vector<float> vertices;
-        std::vector<unsigned int> indices;
-        
-        size_t index = 0;
-        for (auto face_size : shape.mesh.num_face_vertices) {
-            if (face_size != 3) {
-                std::cerr << "!!! face size = " << face_size << " !!!\n";
-                exit(1);
-            }
-            face_count++;
-            for (size_t vi = 0; vi < face_size; vi++, index++) {
-                indices.push_back(vertex_count++);
-                tinyobj::index_t idx = shape.mesh.indices[index];
-
-                auto start = attrib.vertices.begin() + 3 * shape.mesh.indices[index].vertex_index;
-                std::copy(start, start + 3, std::back_insert_iterator<std::vector<float>>(vertices));
-                auto start2 = attrib.normals.begin() + 3 * shape.mesh.indices[index].normal_index;
-                std::copy(start2, start2 + 3, std::back_insert_iterator<std::vector<float>>(vertices));
-
-                tinyobj::real_t tx = attrib.texcoords[2 * idx.texcoord_index + 0];
-                tinyobj::real_t ty = attrib.texcoords[2 * idx.texcoord_index + 1];
-                vertices.push_back(tx);
-                vertices.push_back(ty);
-            }
-        }
-
-        meshes.emplace_back(vertices, indices, std::vector<Material>{ materials[shape.mesh.material_ids[0]] }, std::vector<size_t>{3, 3, 2});
-    }
-
-    return meshes;
-}
-
-void load_cubemap(GLuint &texture) {
-    std::string filenames[] = {
-        // "assets/Bridge/posx.jpg",
-        // "assets/Bridge/negx.jpg",
-        // "assets/Bridge/posy.jpg",
-        // "assets/Bridge/negy.jpg",
-        // "assets/Bridge/posz.jpg",
-        // "assets/Bridge/negz.jpg"
-
-        // "assets/SaintLazarusChurch/posx.jpg",
-        // "assets/SaintLazarusChurch/negx.jpg",
-        // "assets/SaintLazarusChurch/posy.jpg",
-        // "assets/SaintLazarusChurch/negy.jpg",
-        // "assets/SaintLazarusChurch/posz.jpg",
-        // "assets/SaintLazarusChurch/negz.jpg"
-
-        "assets/sky/px.png",
-        "assets/sky/nx.png",
-        "assets/sky/py.png",
-        "assets/sky/ny.png",
-        "assets/sky/pz.png",
-        "assets/sky/nz.png"
-
-        // "assets/testcube/positive-x.tga",
-        // "assets/testcube/negative-x.tga",
-        // "assets/testcube/positive-y.tga",
-        // "assets/testcube/negative-y.tga",
-        // "assets/testcube/positive-z.tga",
-        // "assets/testcube/negative-z.tga"
-    };
-
-    glGenTextures(1, &texture);
-    glBindTexture(GL_TEXTURE_CUBE_MAP, texture);
-
-    stbi_set_flip_vertically_on_load(false);
-
-    int width, height, channels;
-    for (int i = 0; i < 6; i++) {
-        unsigned char *image = stbi_load(filenames[i].c_str(),
-                                         &width,
-                                         &height,
-                                         &channels,
-                                         STBI_rgb);
-
-        std::cout << "loaded " << width << " * " << height << " cubemap face" << std::endl;
-
-        glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB8, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, image);
-        stbi_image_free(image);
-    }
-}
-
-
-std::vector<Mesh> load_object(std::string path, std::string filename) {
-    tinyobj::attrib_t attrib;
-    std::vector<tinyobj::shape_t> shapes;
-    std::vector<tinyobj::material_t> materials;
-
-    std::string warn, err;
-    bool ret = tinyobj::LoadObj(&attrib, &shapes, &materials, &err, filename.c_str());
-
-    if (!warn.empty()) {
-        std::cout << warn << std::endl;
-    }
-    if (!err.empty()) {
-        std::cerr << err << std::endl;
-    }
-
-    if (!ret) { throw "failed loading"; }
-
-    std::vector<Material> mats;
-    for (size_t i = 0; i < materials.size(); i++) {
-        auto &material = materials[i];
-        if (material.diffuse_texname != "") {
-            mats.emplace_back(std::string(path) + material.diffuse_texname);
-        } else {
-            mats.emplace_back(material.diffuse);
-        }
-    }
-
-    return create_object(attrib, shapes, mats);
-}
+const std::vector<std::string> CUBEMAP_FILENAMES = {
+    // "assets/Bridge/posx.jpg",
+    // "assets/Bridge/negx.jpg",
+    // "assets/Bridge/posy.jpg",
+    // "assets/Bridge/negy.jpg",
+    // "assets/Bridge/posz.jpg",
+    // "assets/Bridge/negz.jpg"
+
+    // "assets/SaintLazarusChurch/posx.jpg",
+    // "assets/SaintLazarusChurch/negx.jpg",
+    // "assets/SaintLazarusChurch/posy.jpg",
+    // "assets/SaintLazarusChurch/negy.jpg",
+    // "assets/SaintLazarusChurch/posz.jpg",
+    // "assets/SaintLazarusChurch/negz.jpg"
+
+    "assets/sky/px.png",
+    "assets/sky/nx.png",
+    "assets/sky/py.png",
+    "assets/sky/ny.png",
+    "assets/sky/pz.png",
+    "assets/sky/nz.png"
+
+    // "assets/testcube/positive-x.tga",
+    // "assets/testcube/negative-x.tga",
+    // "assets/testcube/positive-y.tga",
+    // "assets/testcube/negative-y.tga",
+    // "assets/testcube/positive-z.tga",
+    // "assets/testcube/negative-z.tga"
+};
 
 static float pitch = 0.2;
 static float rotation;
@@ -267,7 +183,11 @@ void mouse_callback(GLFWwindow *window, double xpos, double ypos) {
     cursor_position[1] = ypos;
 }
 
-std::pair<Mesh, TorMovementModel> make_torus(
+// longitude sectors of the torus, every one a mesh with its own bounds for culling
+const unsigned int TORUS_CHUNKS = 20;
+
+std::pair<std::vector<Mesh>, TorMovementModel> make_torus(
+    AssetManager &assets,
     unsigned int longitude_size, 
     unsigned int latitude_size, 
     float r, 
@@ -278,45 +198,12 @@ std::pair<Mesh, TorMovementModel> make_torus(
     GLenum error_id;
     const size_t vertex_size = 9;
 
-    // READ FILE
-    std::stringstream file_stream;
-    try {
-        std::ifstream file("assets/landscape_gen.vs");
-        file_stream << file.rdbuf();
-    } catch (std::exception const &e) {
-        std::cerr << "Error reading shader file: " << e.what() << std::endl;
-    }
-
-    std::string transformer_string = file_stream.str();
-    const char *transformer_text = transformer_string.c_str();
-
     // MAKE A PROGRAM
-    GLuint shader = glCreateShader(GL_VERTEX_SHADER);
-    glShaderSource(shader, 1, &transformer_text, nullptr);
-    glCompileShader(shader);
-
-    // check error
-    int success;
-    char infoLog[1024];
-    glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
-    if (!success) {
-        glGetShaderInfoLog(shader, 1024, NULL, infoLog);
-        std::cerr << "Error compiling Vertex shader_t:\n"
-                  << infoLog << std::endl;
-    }
-
-    GLuint program = glCreateProgram();
-    glAttachShader(program, shader);
-
-    // CREATE BUFFERS
-    const GLchar *result_name[] = { "out_position", "out_normal", "out_texcoord", "out_height" };
-    glTransformFeedbackVaryings(program, 4, result_name, GL_INTERLEAVED_ATTRIBS);
-
-    glLinkProgram(program);
+    shader_t transformer("assets/landscape_gen.vs", { "out_position", "out_normal", "out_texcoord", "out_height" });
 
     // GET RESOURCES
-    Material moon_mat("assets/moon.jpg");
-    Material steel_mat("assets/metal dec.jpg", 0.7);
+    Material moon_mat(assets.texture("assets/moon.jpg"));
+    Material steel_mat(assets.texture("assets/metal dec.jpg"), 0.7);
 
     GLuint height_map, normal_map;
     glGenTextures(1, &height_map);
@@ -334,27 +221,28 @@ std::pair<Mesh, TorMovementModel> make_torus(
     glBufferData(GL_ARRAY_BUFFER, result_size * sizeof(float), nullptr, GL_STATIC_READ);
 
     // SET INPUTS
-    glUseProgram(program);
+    transformer.use();
 
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, height_map);
-    glActiveTexture(GL_TEXTURE1);
-    glBindTexture(GL_TEXTURE_2D, normal_map);
+    gl_state::bind_texture(0, GL_TEXTURE_2D, height_map);
+    gl_state::bind_texture(1, GL_TEXTURE_2D, normal_map);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    // the maps are sampled with their own parameters, not the samplers the frame left on these units
+    unbind_sampler(0);
+    unbind_sampler(1);
 
-    glUniform1i(glGetUniformLocation(program, "height_map"), 0);
-    glUniform1i(glGetUniformLocation(program, "normal_map"), 1); // unused
-    glUniform1f(glGetUniformLocation(program, "R"), R);
-    glUniform1f(glGetUniformLocation(program, "r"), r);
-    glUniform1f(glGetUniformLocation(program, "badrock_height"), badrock_height);
-    glUniform1f(glGetUniformLocation(program, "height_mult"), height_mult);
+    transformer.set_uniform("height_map", 0);
+    transformer.set_uniform("normal_map", 1); // unused
+    transformer.set_uniform("R", R);
+    transformer.set_uniform("r", r);
+    transformer.set_uniform("badrock_height", badrock_height);
+    transformer.set_uniform("height_mult", height_mult);
 
     // RUN PROGRAM
     GLuint query;
     glGenQueries(1, &query);
 
-    glEnable(GL_RASTERIZER_DISCARD);
+    gl_state::set_enabled(GL_RASTERIZER_DISCARD, true);
 
     glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, outbuff); // SET INPUT
 
@@ -364,7 +252,7 @@ std::pair<Mesh, TorMovementModel> make_torus(
     glEndTransformFeedback();
     glEndQuery(GL_TRANSFORM_FEEDBACK_PRIMITIVES_WRITTEN);
 
-    glDisable(GL_RASTERIZER_DISCARD);
+    gl_state::set_enabled(GL_RASTERIZER_DISCARD, false);
 
     glFlush();
 
@@ -408,48 +296,79 @@ std::pair<Mesh, TorMovementModel> make_torus(
         0, 6, 8, 3,
         longitude_size, latitude_size);
 
-    Mesh tor_mesh = Mesh(result_data, indices, std::vector<Material> { moon_mat, steel_mat }, { 3, 3, 2, 1 });
+    // the plane is emitted longitude column after column, a chunk is a run of whole columns
+    std::vector<Mesh> tor_meshes;
+    for (unsigned int chunk = 0; chunk < TORUS_CHUNKS; chunk++) {
+        size_t first = size_t(longitude_size) * chunk / TORUS_CHUNKS * latitude_size * 6;
+        size_t end = size_t(longitude_size) * (chunk + 1) / TORUS_CHUNKS * latitude_size * 6;
+        tor_meshes.emplace_back(&result_data[first * vertex_size], (end - first) * vertex_size, &indices[0], end - first,
+                                std::vector<Material> { moon_mat, steel_mat }, std::vector<size_t> { 3, 3, 2, 1 },
+                                std::vector<AttribFormat> { AttribFormat::HALF, AttribFormat::NORMAL_10_10_10, AttribFormat::UNORM16, AttribFormat::FLOAT });
+    }
 
-    return { tor_mesh, model };
+    return { tor_meshes, model };
 }
 
-int main(int, char **) {
-    GLFWwindow *window = init_window();
+int main(int argc, char **argv) {
+    HeadlessOptions headless = parse_headless_options(argc, argv);
+
+    GLFWwindow *window = NULL;
+    if (headless.enabled) {
+        if (!init_headless_context(headless.width, headless.height))
+            return 1;
+    } else {
+        window = init_window();
+    }
 
-    std::vector<Mesh> car_meshes = load_object("assets/reflex_camera/", "reflex_camera.obj");
+    // textures and models stream in while the first frames are drawn with placeholders
+    AssetManager assets;
+    assets.textures().set_budget(TEXTURE_BUDGET_BYTES);
 
-    GLuint cubemap_texture;
-    load_cubemap(cubemap_texture);
+    std::vector<Mesh> &car_meshes = assets.object("assets/reflex_camera/", "reflex_camera.obj");
+
+    TextureRef cubemap_texture = assets.cubemap(CUBEMAP_FILENAMES);
 
     // create our geometries
     GLuint vbo, vao, ebo;
     create_skybox( vbo, vao, ebo);
 
-    // init shaders
+    // init shaders, linked programs are reused from shader_cache/ when the sources did not change
+    auto const shaders_start = std::chrono::steady_clock::now();
     shader_t skybox_shader("assets/skybox.vs", "assets/skybox.fs");
-    shader_t moon_shader("assets/moon.vs", "assets/moon.fs");
-    shader_t object_shader("assets/object.vs", "assets/object.fs");
     shader_t id_shader("assets/id.vs", "assets/id.fs");
 
-    std::cerr << "shaders done\n";
+    // lit programs are compiled per feature set, the sampler units are the same for every variant
+    auto set_scene_samplers = [](shader_t &shader) {
+        shader.set_uniform("u_cube", 0);
+        shader.set_uniform("dl_depth", 10);
+        shader.set_uniform("pd_depth", 11);
+    };
+    ShaderPermutations moon_shaders("assets/moon.vs", "assets/moon.fs", set_scene_samplers);
+    ShaderPermutations object_shaders("assets/object.vs", "assets/object.fs", set_scene_samplers);
+    uniform_handle<glm::mat4> id_mvp = id_shader.get_handle<glm::mat4>("u_mvp");
+
+    // camera and lights are shared by all programs through these
+    UniformBlock<CameraBlock> camera_block("Camera");
+    UniformBlock<LightsBlock> lights_block("Lights");
 
-    setup_imgui(window);
+    if (!headless.enabled) {
+        setup_imgui(window);
 
-    glfwSetScrollCallback(window, &scroll_callback);
-    glfwSetCursorPosCallback(window, &mouse_callback);
+        glfwSetScrollCallback(window, &scroll_callback);
+        glfwSetCursorPosCallback(window, &mouse_callback);
+    }
 
     auto const start_time = std::chrono::steady_clock::now();
 
     float r = 0.7, R = 5, height_mult = 0.8, badrock_height = 0.3;
-    auto tmp = make_torus(300, std::max(5, int(300 * r / R)), r, R, height_mult, badrock_height);
-    Mesh tor = tmp.first;
+    auto tmp = make_torus(assets, 300, std::max(5, int(300 * r / R)), r, R, height_mult, badrock_height);
     TorMovementModel mmodel = tmp.second;
     model_p = &mmodel;
 
     int tile_x = 8;
     int tile_y = std::max(1, int(tile_x * r / R));
 
-    std::vector<Mesh> meshes = std::vector<Mesh>(1, tor);
+    std::vector<Mesh> meshes = tmp.first;
 
     glm::vec3 camera_offset_old;
     glm::vec3 camera_center_old;
@@ -459,7 +378,9 @@ int main(int, char **) {
 
     const float max_radius = R + r + height_mult + 1.5 + 10;
 
-    Shadow sun_shadow = Shadow(2048 * 4, 2048 * 4);
+    // cascades follow the camera, 16 MB instead of a single 8192^2 map over the whole scene, PCF hides the texels
+    // the moon is cached per cascade, the moving car is drawn over a copy of it every frame
+    CascadedShadow sun_shadow(1024, SHADOW_CASCADES, true);
     Shadow torch_shadow = Shadow(512, 512);
 
     // controls
@@ -467,17 +388,72 @@ int main(int, char **) {
     static float sun_speed_log = -20;
     static float sun_start_a = 3.4;
     static float camera_radius_mult = 1;
+    static bool texture_gamma_correction = true;
+    static bool blend_gamma_correction = true;
+    static bool shadows_enabled = true;
+    // a shader_features::PCF_ kernel
+    static int shadow_filter = shader_features::PCF_POISSON;
+
+    // sun and the torch
+    auto lit_features = [&]() {
+        unsigned features = shader_features::dl_count(1) | shader_features::pd_count(1);
+        if (texture_gamma_correction)
+            features |= shader_features::TEX_GAMMA_CORRECT;
+        if (blend_gamma_correction)
+            features |= shader_features::BLEND_GAMMA_CORRECT;
+        if (shadows_enabled)
+            features |= shader_features::SHADOWS | shader_features::pcf(shadow_filter);
+        return features;
+    };
+    moon_shaders.get(lit_features());
+    object_shaders.get(lit_features());
+    std::cerr << "shaders done in " << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - shaders_start).count() << " ms\n";
+
+    // edited shader files are recompiled between frames, the benchmark keeps the programs fixed
+    ShaderWatcher shader_watcher;
+    if (!headless.enabled) {
+        shader_watcher.watch(skybox_shader);
+        shader_watcher.watch(id_shader);
+        shader_watcher.watch(moon_shaders);
+        shader_watcher.watch(object_shaders);
+    }
+
+    // the benchmark measures the complete scene
+    if (headless.enabled)
+        assets.finish();
 
-    while (!glfwWindowShouldClose(window)) {
+    FrameTimes frame_times(headless.enabled ? headless.frames : 0);
+    int frame_index = 0;
 
-        glfwPollEvents();
+    Profiler profiler;
+    shader_t::upload_stats = uniform_upload_stats();
+
+    while (headless.enabled ? frame_index < headless.frames : !glfwWindowShouldClose(window)) {
+        frame_times.begin_frame();
+        profiler.begin_frame();
+        // imgui and the setup code change GL state behind the tracker
+        gl_state::invalidate();
+        assets.update(ASSET_UPLOAD_BUDGET_MS);
 
         // Get windows size
         int display_w, display_h;
-        glfwGetFramebufferSize(window, &display_w, &display_h);
+        float time_from_start;
+        if (headless.enabled) {
+            display_w = headless.width;
+            display_h = headless.height;
+            time_from_start = frame_index / 60.0f;
+
+            // fixed camera path: the model drives forward along a slow curve
+            mmodel.move_forvard(1);
+            mmodel.rotate(0.002);
+        } else {
+            glfwPollEvents();
+            shader_watcher.poll();
+            glfwGetFramebufferSize(window, &display_w, &display_h);
+            time_from_start = (float)(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start_time).count() / 1000.0);
+        }
 
         auto const frame_start_time = std::chrono::steady_clock::now();
-        float const time_from_start = (float)(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start_time).count() / 1000.0);
 
         glm::mat4 sun_rotation = glm::rotate(
             sun_start_a + time_from_start * 2 * float(M_PI) * powf(2, sun_speed_log),
@@ -524,202 +500,224 @@ int main(int, char **) {
             camera_position,
             camera_center,
             camera_up);
-        auto projection = glm::perspective<float>(glm::radians(fovy), float(display_w) / display_h, 0.1, 100);
+        const float z_near = 0.1, z_far = 100;
+        auto projection = glm::perspective<float>(glm::radians(fovy), float(display_w) / display_h, z_near, z_far);
         auto mvp = projection * view * model;
         auto vp = projection * view;
         auto mvp_no_translation = projection * glm::mat4(glm::mat3(view * model));
 
         auto car_mvp = projection * view * car_model;
 
+        // the moon never moves, a cascade's static layer is only drawn again when its box moved
+        std::vector<ShadowCaster> static_casters = { { model, meshes.size() } };
+        size_t shadow_draws = 0;
+        size_t shadow_triangles = 0, culled_shadow_triangles = 0;
+
+        // skips the meshes outside the light's view volume
+        auto draw_casters = [&](std::vector<Mesh>& casters, const glm::mat4& shadow_mvp) {
+            id_shader.set_uniform(id_mvp, shadow_mvp);
+            Frustum frustum(shadow_mvp);
+            for (Mesh &mesh : casters) {
+                if (frustum.intersects(mesh.bounds_min, mesh.bounds_max)) {
+                    mesh.draw();
+                    shadow_triangles += mesh.triangle_count();
+                } else {
+                    culled_shadow_triangles += mesh.triangle_count();
+                }
+            }
+        };
+
         // get sun shadow
-        sun_shadow.set_shadow(
-            glm::ortho(-max_radius, max_radius, -max_radius, max_radius, -max_radius, max_radius) * glm::lookAt(sun_position, glm::vec3(0, 0, 0), glm::vec3(0, 1, 0)));
+        profiler.begin_pass("sun shadow");
+        sun_shadow.fit(view, glm::radians(fovy), float(display_w) / display_h, z_near, z_far, sun_position, glm::vec3(0, 0, 0), max_radius);
 
         id_shader.use();
-        {
-            glm::mat4 shadow_mvp;
-            shadow_mvp = sun_shadow.view * model;
-            id_shader.set_uniform("u_mvp", glm::value_ptr(shadow_mvp));
-            for (Mesh &mesh : meshes) {
-                mesh.draw();
-            }
-            shadow_mvp = sun_shadow.view * car_model;
-            id_shader.set_uniform("u_mvp", glm::value_ptr(shadow_mvp));
-            for (Mesh &mesh : car_meshes) {
-                mesh.draw();
+        for (size_t c = 0; c < SHADOW_CASCADES; c++) {
+            if (sun_shadow.set_static_cascade(c, static_casters)) {
+                shadow_draws++;
+                draw_casters(meshes, sun_shadow.views[c] * model);
             }
+            sun_shadow.set_dynamic_cascade(c);
+            draw_casters(car_meshes, sun_shadow.views[c] * car_model);
         }
 
         sun_shadow.unset_shadow();
+        profiler.end_pass();
 
         glm::vec3 torch_dir = forward * 1.2f - 0.1f * model_up;
         glm::vec3 torch_pos = model_pos + model_up * 0.07f + forward * 0.2f;
 
 
         // get torch shadow
+        profiler.begin_pass("torch shadow");
+        // the torch moves with the car
+        shadow_draws++;
         torch_shadow.set_shadow(
             glm::perspective<float>(glm::radians(130.0), 1, 0.01, 10) *
             glm::lookAt(torch_pos, torch_pos + torch_dir, model_up));
 
         id_shader.use();
-        {
-            glm::mat4 shadow_mvp;
-            shadow_mvp = torch_shadow.view * model;
-            id_shader.set_uniform("u_mvp", glm::value_ptr(shadow_mvp));
-            for (Mesh &mesh : meshes) {
-                mesh.draw();
-            }
-            shadow_mvp = torch_shadow.view * car_model;
-            id_shader.set_uniform("u_mvp", glm::value_ptr(shadow_mvp));
-            for (Mesh &mesh : car_meshes) {
-                mesh.draw();
-            }
-        }
+        draw_casters(meshes, torch_shadow.view * model);
+        draw_casters(car_meshes, torch_shadow.view * car_model);
 
         torch_shadow.unset_shadow();
+        profiler.end_pass();
+
+        camera_block.value.u_vp = vp;
+        camera_block.value.u_cam = camera_position;
+        camera_block.value.u_cam_forward = glm::normalize(camera_center - camera_position);
+        camera_block.upload();
+
+        LightsBlock &lights = lights_block.value;
+        lights.background_light = glm::vec3(1, 1, 1) * 0.9f;
+        lights.dl_num = 1;
+        lights.dl_dir[0] = glm::vec4(sun_position, 0);
+        lights.dl_light[0] = glm::vec4(1.0f, 1.0f, 1.0f, 0);
+        for (size_t c = 0; c < SHADOW_CASCADES; c++) {
+            lights.dl_vp[c] = sun_shadow.views[c];
+        }
+        lights.pd_num = 1;
+        lights.pd_dir[0] = glm::vec4(torch_dir, 0);
+        lights.pd_pos[0] = glm::vec4(torch_pos, 0);
+        lights.pd_light[0] = glm::vec4(glm::vec3(1.0f, 1.0f, 0.5f) * 0.5f, 0);
+        lights.pd_angle[0].x = 0.6f;
+        lights.pd_vp[0] = torch_shadow.view;
+        lights_block.upload();
 
         // start actual drawing
 
         // Set viewport to fill the whole window area
-        glViewport(0, 0, display_w, display_h);
+        gl_state::viewport(0, 0, display_w, display_h);
 
         // Fill background with solid color
         // glClearColor(0.30f, 0.55f, 0.60f, 1.00f);
         // glEnable(GL_CULL_FACE);
 
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-        glEnable(GL_DEPTH_TEST);
-        glDepthFunc(GL_LEQUAL);
+        gl_state::set_enabled(GL_DEPTH_TEST, true);
+        gl_state::depth_func(GL_LEQUAL);
+
+        if (!headless.enabled) {
+            // Gui start new frame
+            ImGui_ImplOpenGL3_NewFrame();
+            ImGui_ImplGlfw_NewFrame();
+            ImGui::NewFrame();
+
+            // GUI
+            ImGui::Begin("Triangle Position/Color");
+            static float fovy = 90;
+            ImGui::SliderFloat("fovy", &fovy, 10, 180);
+            ImGui::SliderFloat("sun start a", &sun_start_a, 0, 2 * M_PI);
+            ImGui::SliderFloat("sun speed log", &sun_speed_log, -20, 0);
+            ImGui::SliderFloat("camera radius", &camera_radius_mult, 0.5, 5);
 
-        // Gui start new frame
-        ImGui_ImplOpenGL3_NewFrame();
-        ImGui_ImplGlfw_NewFrame();
-        ImGui::NewFrame();
+            ImGui::Checkbox("texture gamma correction", &texture_gamma_correction);
 
-        // GUI
-        ImGui::Begin("Triangle Position/Color");
-        static float fovy = 90;
-        ImGui::SliderFloat("fovy", &fovy, 10, 180);
-        ImGui::SliderFloat("sun start a", &sun_start_a, 0, 2 * M_PI);
-        ImGui::SliderFloat("sun speed log", &sun_speed_log, -20, 0);
-        ImGui::SliderFloat("camera radius", &camera_radius_mult, 0.5, 5);
+            ImGui::Checkbox("blend gamma correction", &blend_gamma_correction);
 
-        static bool texture_gamma_correction = true;
-        ImGui::Checkbox("texture gamma correction", &texture_gamma_correction);
+            ImGui::Checkbox("shadows", &shadows_enabled);
 
-        static bool blend_gamma_correction = true;
-        ImGui::Checkbox("blend gamma correction", &blend_gamma_correction);
+            ImGui::Combo("shadow filter", &shadow_filter, "hardware 2x2\0rotated grid\0poisson\0");
 
-        ImGui::End();
+            profiler.draw_imgui();
+
+            ImGui::End();
+        }
 
+        profiler.begin_pass("skybox");
         skybox_shader.use();
         skybox_shader.set_uniform("u_mvp", glm::value_ptr(mvp_no_translation));
         skybox_shader.set_uniform("u_cube", int(0));
-        skybox_shader.set_uniform("dl_num", 1);
-        skybox_shader.set_uniform("dl_dir", sun_position);
-        skybox_shader.set_uniform("dl_light", glm::vec3(1.0f, 1.0f, 1.0f));
-
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_CUBE_MAP, cubemap_texture);
-        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-
-        // Bind vertex array = buffers + indices
-        glBindVertexArray(vao);
-        // Execute draw call
+
+        gl_state::bind_texture(0, GL_TEXTURE_CUBE_MAP, *cubemap_texture);
+        bind_sampler(0, SKYBOX_SAMPLER);
+
+        gl_state::bind_vertex_array(vao);
         glDrawElements(GL_TRIANGLES, 6 * 6, GL_UNSIGNED_INT, 0);
-        glBindTexture(GL_TEXTURE_2D, 0);
-        glBindVertexArray(0);
+        profiler.end_pass();
 
 
-        glColorMask(0, 0, 0, 0);
+        profiler.begin_pass("depth prepass");
+        gl_state::color_mask(false);
         id_shader.use();
-        id_shader.set_uniform("u_mvp", glm::value_ptr(mvp));
+        id_shader.set_uniform(id_mvp, mvp);
         for (Mesh &mesh : meshes) {
             mesh.draw();
         }
-        id_shader.set_uniform("u_mvp", glm::value_ptr(car_mvp));
+        id_shader.set_uniform(id_mvp, car_mvp);
         for (Mesh &mesh : car_meshes) {
             mesh.draw();
         }
 
-        glColorMask(1, 1, 1, 1);
+        profiler.end_pass();
+
+        profiler.begin_pass("moon");
+        gl_state::color_mask(true);
+        shader_t &moon_shader = moon_shaders.get(lit_features());
         moon_shader.use();
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_CUBE_MAP, cubemap_texture);
-        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+        gl_state::bind_texture(0, GL_TEXTURE_CUBE_MAP, *cubemap_texture);
+        bind_sampler(0, SKYBOX_SAMPLER);
 
         sun_shadow.bind_shadow_texture(10);
         torch_shadow.bind_shadow_texture(11);
 
-        auto pass_everything_lambda = [&](shader_t &shader) {
-            shader.set_uniform("u_cam", camera_position.x, camera_position.y, camera_position.z);
-
-            shader.set_uniform("u_cube", int(0));
-
-            shader.set_uniform("u_tex_gamma_correct", texture_gamma_correction);
-            shader.set_uniform("u_blend_gamma_correct", blend_gamma_correction);
-
-            shader.set_uniform("dl_num", 1);
-            shader.set_uniform("dl_dir", sun_position);
-            shader.set_uniform("dl_light", glm::vec3(1.0f, 1.0f, 1.0f));
-            shader.set_uniform("dl_depth", 10);
-            shader.set_uniform("dl_vp", glm::value_ptr(sun_shadow.view));
-
-            shader.set_uniform("pd_num", 1);
-            shader.set_uniform("pd_dir", torch_dir);
-            shader.set_uniform("pd_pos", torch_pos);
-            shader.set_uniform("pd_light", glm::vec3(1.0f, 1.0f, 0.5f) * 0.5f);
-            shader.set_uniform("pd_angle", 0.6f);
-            shader.set_uniform("pd_depth", 11);
-            shader.set_uniform("pd_vp", glm::value_ptr(torch_shadow.view));
-
-            shader.set_uniform("background_light", glm::vec3(1, 1, 1) * 0.9f);
-        };
-
         moon_shader.set_uniform<float>("u_tile", tile_x, tile_y);
         moon_shader.set_uniform("u_m", glm::value_ptr(model));
         moon_shader.set_uniform("u_mvp", glm::value_ptr(mvp));
         moon_shader.set_uniform("u_badrock_height", badrock_height);
-        pass_everything_lambda(moon_shader);
 
         for (Mesh &mesh : meshes) {
             mesh.draw(moon_shader);
         }
 
+        profiler.end_pass();
+
         mvp_no_translation = projection * glm::mat4(glm::mat3(view * car_model));
 
+        profiler.begin_pass("objects");
+        shader_t &object_shader = object_shaders.get(lit_features());
         object_shader.use();
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_CUBE_MAP, cubemap_texture);
-        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+        gl_state::bind_texture(0, GL_TEXTURE_CUBE_MAP, *cubemap_texture);
+        bind_sampler(0, SKYBOX_SAMPLER);
 
         object_shader.set_uniform("u_m", glm::value_ptr(car_model));
         object_shader.set_uniform("u_mvp", glm::value_ptr(car_mvp));
         object_shader.set_uniform<float>("u_tile", 1, 1);
-        pass_everything_lambda(object_shader);
         // object_shader.set_uniform("background_light", 0.7f, 0.7f, 0.7f);
 
         for (Mesh &mesh : car_meshes) {
             mesh.draw(object_shader);
         }
+        profiler.end_pass();
+
+        profiler.counter("uniform uploads", shader_t::upload_stats.issued);
+        profiler.counter("skipped uniform uploads", shader_t::upload_stats.skipped);
+        profiler.counter("pending assets", assets.pending());
+        profiler.counter("resident textures", assets.textures().count());
+        profiler.counter("texture KB", assets.textures().bytes() >> 10);
+        profiler.counter("state changes", gl_state::stats.issued);
+        profiler.counter("skipped state changes", gl_state::stats.skipped);
+        profiler.counter("shadow maps drawn", shadow_draws);
+        profiler.counter("shadow triangles", shadow_triangles);
+        profiler.counter("culled shadow triangles", culled_shadow_triangles);
+        shader_t::upload_stats = uniform_upload_stats();
+        gl_state::stats = gl_state_stats();
+
+        if (headless.enabled) {
+            frame_times.end_frame();
+            frame_index++;
+            continue;
+        }
 
         // Generate gui render commands
+        profiler.begin_pass("imgui");
+        // imgui samples its font on unit 0 with the texture's parameters
+        unbind_sampler(0);
         ImGui::Render();
 
         // Execute gui render commands using OpenGL backend
         ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+        profiler.end_pass();
 
         // Swap the backbuffer with the frontbuffer that is used for screen display
         glfwSwapBuffers(window);
@@ -727,6 +725,14 @@ int main(int, char **) {
         wait_fps_cap(frame_start_time);
     }
 
+    if (headless.enabled) {
+        frame_times.write_csv(headless.csv_filename);
+        profiler.dump("pass_times.csv");
+        destroy_headless_context();
+        model_p = nullptr;
+        return 0;
+    }
+
     // Cleanup
     ImGui_ImplOpenGL3_Shutdown();
     ImGui_ImplGlfw_Shutdown();
@@ -0,0 +1,75 @@
+#include "mapped_file.h"
+
+#include <fstream>
+
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+MappedFile::~MappedFile() {
+    close();
+}
+
+bool MappedFile::open(const std::string& filename) {
+    close();
+#ifdef _WIN32
+    std::ifstream file(filename, std::ios::binary | std::ios::ate);
+    if (!file)
+        return false;
+    buffer.resize(file.tellg());
+    file.seekg(0);
+    if (buffer.empty() || !file.read((char*)buffer.data(), buffer.size())) {
+        buffer.clear();
+        return false;
+    }
+    data_ = buffer.data();
+    size_ = buffer.size();
+#else
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd == -1)
+        return false;
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        void* mapping = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapping != MAP_FAILED) {
+            data_ = (const unsigned char*)mapping;
+            size_ = st.st_size;
+        }
+    }
+    ::close(fd);
+#endif
+    return data_ != nullptr;
+}
+
+void MappedFile::close() {
+#ifdef _WIN32
+    buffer.clear();
+#else
+    if (data_ != nullptr)
+        munmap((void*)data_, size_);
+#endif
+    data_ = nullptr;
+    size_ = 0;
+}
+
+bool source_stat(const std::string& filename, uint64_t& size, int64_t& mtime) {
+    struct stat st;
+    if (stat(filename.c_str(), &st) != 0)
+        return false;
+    size = st.st_size;
+    mtime = st.st_mtime;
+    return true;
+}
+
+void make_cache_directory(const char* directory) {
+#ifdef _WIN32
+    _mkdir(directory);
+#else
+    mkdir(directory, 0755);
+#endif
+}
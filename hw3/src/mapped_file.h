@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Read only mapping of a whole file, shared by the mesh and texture caches
+class MappedFile {
+  public:
+    MappedFile() = default;
+    ~MappedFile();
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    // false if the file is missing or empty
+    bool open(const std::string& filename);
+    void close();
+
+    const unsigned char* data() const { return data_; }
+    size_t size() const { return size_; }
+
+  private:
+    const unsigned char* data_ = nullptr;
+    size_t size_ = 0;
+#ifdef _WIN32
+    // no mmap, the file is read into memory
+    std::vector<unsigned char> buffer;
+#endif
+};
+
+// size and modification time, baked files store them to notice a changed source
+bool source_stat(const std::string& filename, uint64_t& size, int64_t& mtime);
+
+// relative to the working directory, an existing one is fine
+void make_cache_directory(const char* directory);
@@ -0,0 +1,32 @@
+// Offline OBJ -> mesh_cache converter: mesh-baker <file.obj> [<out.mesh>]
+// Without an output name the file goes where the app looks for it, so run it from build/
+#include <iostream>
+
+#include "mesh_cache.h"
+
+int main(int argc, char **argv) {
+    if (argc < 2 || argc > 3) {
+        std::cerr << "usage: " << argv[0] << " <file.obj> [<out.mesh>]" << std::endl;
+        return 1;
+    }
+    std::string obj_filename = argv[1];
+    std::string mesh_filename = argc == 3 ? argv[2] : mesh_cache_filename(obj_filename);
+    if (!bake_mesh(obj_filename, mesh_filename)) {
+        std::cerr << "failed baking " << obj_filename << std::endl;
+        return 1;
+    }
+
+    MeshFile file;
+    if (!file.open(mesh_filename)) {
+        std::cerr << "failed reading back " << mesh_filename << std::endl;
+        return 1;
+    }
+    size_t vertices = 0, indices = 0;
+    for (size_t i = 0; i < file.header().mesh_count; i++) {
+        vertices += file.mesh(i).vertex_count;
+        indices += file.mesh(i).index_count;
+    }
+    std::cout << mesh_filename << ": " << file.header().mesh_count << " meshes, " << file.header().material_count << " materials, "
+              << vertices << " vertices, " << indices / 3 << " triangles" << std::endl;
+    return 0;
+}
@@ -0,0 +1,282 @@
+#include "mesh_cache.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <unordered_map>
+
+#include <glm/glm.hpp>
+
+#include "mapped_file.h"
+#include "mesh_optimizer.h"
+#include "obj_parser.h"
+#include "parallel.h"
+
+namespace {
+const char* CACHE_DIR = "mesh_cache";
+
+struct MeshData {
+    std::vector<float> vertices;
+    std::vector<uint32_t> indices;
+    uint32_t material;
+};
+
+// all 8 floats of a vertex, compared bitwise
+struct VertexKey {
+    float v[MESH_VERTEX_FLOATS];
+
+    bool operator==(const VertexKey& other) const { return std::memcmp(v, other.v, sizeof(v)) == 0; }
+};
+
+struct VertexKeyHash {
+    size_t operator()(const VertexKey& key) const {
+        // FNV-1a
+        uint64_t hash = 14695981039346656037ull;
+        const unsigned char* bytes = (const unsigned char*)key.v;
+        for (size_t i = 0; i < sizeof(key.v); i++) {
+            hash ^= bytes[i];
+            hash *= 1099511628211ull;
+        }
+        return hash;
+    }
+};
+
+size_t align16(size_t offset) {
+    return (offset + 15) & ~size_t(15);
+}
+
+// every face corner is a vertex: position, normal (the face normal if the OBJ has none), texcoord.
+// Corners with equal vertices are welded into one, so the index buffer references shared vertices
+bool expand_mesh(const ObjData& data, const ObjMesh& obj_mesh, MeshData& mesh) {
+    std::unordered_map<VertexKey, uint32_t, VertexKeyHash> welded;
+    welded.reserve(obj_mesh.corners.size() / 3);
+    mesh.material = obj_mesh.material < 0 ? NO_MATERIAL : obj_mesh.material;
+
+    const int position_count = data.positions.size() / 3;
+    const int texcoord_count = data.texcoords.size() / 2;
+    const int normal_count = data.normals.size() / 3;
+    for (size_t face = 0; face < obj_mesh.corners.size(); face += 9) {
+        const int* corners = &obj_mesh.corners[face];
+        glm::vec3 vert[3];
+        for (size_t vi = 0; vi < 3; vi++) {
+            int position = corners[3 * vi];
+            if (position < 0 || position >= position_count)
+                return false;
+            vert[vi] = glm::vec3(data.positions[3 * position + 0], data.positions[3 * position + 1], data.positions[3 * position + 2]);
+        }
+        glm::vec3 def_normal = glm::normalize(glm::cross(vert[2] - vert[0], vert[1] - vert[0]));
+
+        for (size_t vi = 0; vi < 3; vi++) {
+            int texcoord = corners[3 * vi + 1];
+            int normal = corners[3 * vi + 2];
+            VertexKey key;
+
+            std::copy_n(data.positions.begin() + 3 * corners[3 * vi], 3, key.v);
+            if (normal >= 0 && normal < normal_count) {
+                std::copy_n(data.normals.begin() + 3 * normal, 3, key.v + 3);
+            } else {
+                // use default normal
+                key.v[3] = def_normal.x;
+                key.v[4] = def_normal.y;
+                key.v[5] = def_normal.z;
+            }
+
+            if (texcoord >= 0 && texcoord < texcoord_count) {
+                key.v[6] = data.texcoords[2 * texcoord + 0];
+                key.v[7] = data.texcoords[2 * texcoord + 1];
+            } else {
+                key.v[6] = 0;
+                key.v[7] = 0;
+            }
+
+            auto inserted = welded.emplace(key, uint32_t(mesh.vertices.size() / MESH_VERTEX_FLOATS));
+            if (inserted.second)
+                mesh.vertices.insert(mesh.vertices.end(), key.v, key.v + MESH_VERTEX_FLOATS);
+            mesh.indices.push_back(inserted.first->second);
+        }
+    }
+    return true;
+}
+
+void grow_bounds(float bounds_min[3], float bounds_max[3], const float* position) {
+    for (int i = 0; i < 3; i++) {
+        bounds_min[i] = std::min(bounds_min[i], position[i]);
+        bounds_max[i] = std::max(bounds_max[i], position[i]);
+    }
+}
+}
+
+std::string mesh_cache_filename(const std::string& obj_filename) {
+    std::string name = obj_filename;
+    std::replace(name.begin(), name.end(), '/', '_');
+    std::replace(name.begin(), name.end(), '\\', '_');
+    return std::string(CACHE_DIR) + "/" + name + ".mesh";
+}
+
+bool bake_mesh(const std::string& obj_filename, const std::string& mesh_filename) {
+    ObjData data;
+    if (!parse_obj(obj_filename, data))
+        return false;
+    const std::vector<ObjMaterial>& materials = data.materials;
+
+    // meshes are independent, each one is welded and optimized on its own thread
+    std::vector<MeshData> meshes(data.meshes.size());
+    std::vector<char> expanded(meshes.size());
+    parallel_for(meshes.size(), [&](size_t i) {
+        expanded[i] = expand_mesh(data, data.meshes[i], meshes[i]);
+    });
+    if (std::find(expanded.begin(), expanded.end(), false) != expanded.end()) {
+        std::cerr << obj_filename << ": face index out of range" << std::endl;
+        return false;
+    }
+    size_t corner_count = 0, vertex_count = 0;
+    for (const MeshData& mesh : meshes) {
+        corner_count += mesh.indices.size();
+        vertex_count += mesh.vertices.size() / MESH_VERTEX_FLOATS;
+    }
+    std::cout << obj_filename << ": " << corner_count << " triangle corners welded into " << vertex_count << " vertices" << std::endl;
+
+    // every mesh is drawn in several passes a frame, the reordering pays off in each of them
+    struct OptimizeStats {
+        VertexCacheStats cache_before, cache_after;
+        float overdraw_before, overdraw_after;
+    };
+    std::vector<OptimizeStats> stats(meshes.size());
+    parallel_for(meshes.size(), [&](size_t i) {
+        MeshData& mesh = meshes[i];
+        size_t mesh_vertex_count = mesh.vertices.size() / MESH_VERTEX_FLOATS;
+        stats[i].cache_before = analyze_vertex_cache(mesh.indices, mesh_vertex_count);
+        stats[i].overdraw_before = analyze_overdraw(mesh.indices, mesh.vertices, MESH_VERTEX_FLOATS);
+
+        optimize_mesh(mesh.vertices, MESH_VERTEX_FLOATS, mesh.indices);
+
+        stats[i].cache_after = analyze_vertex_cache(mesh.indices, mesh.vertices.size() / MESH_VERTEX_FLOATS);
+        stats[i].overdraw_after = analyze_overdraw(mesh.indices, mesh.vertices, MESH_VERTEX_FLOATS);
+    });
+    for (size_t i = 0; i < meshes.size(); i++) {
+        std::cout << "  mesh " << i << ": " << meshes[i].indices.size() / 3 << " triangles, ACMR " << stats[i].cache_before.acmr << " -> " << stats[i].cache_after.acmr
+                  << ", ATVR " << stats[i].cache_before.atvr << " -> " << stats[i].cache_after.atvr
+                  << ", overdraw " << stats[i].overdraw_before << " -> " << stats[i].overdraw_after << std::endl;
+    }
+
+    MeshFileHeader header = {};
+    header.magic = MESH_FILE_MAGIC;
+    header.version = MESH_FILE_VERSION;
+    source_stat(obj_filename, header.source_size, header.source_mtime);
+    header.mesh_count = meshes.size();
+    header.material_count = materials.size();
+    for (int i = 0; i < 3; i++) {
+        header.bounds_min[i] = 1e30f;
+        header.bounds_max[i] = -1e30f;
+    }
+
+    std::vector<MeshFileMaterial> file_materials(materials.size());
+    for (size_t i = 0; i < materials.size(); i++) {
+        MeshFileMaterial& material = file_materials[i];
+        std::memset(&material, 0, sizeof(material));
+        if (materials[i].diffuse_texname.size() >= sizeof(material.texture)) {
+            std::cerr << "texture name too long: " << materials[i].diffuse_texname << std::endl;
+            return false;
+        }
+        std::strcpy(material.texture, materials[i].diffuse_texname.c_str());
+        std::copy(materials[i].diffuse, materials[i].diffuse + 3, material.diffuse);
+    }
+
+    std::vector<MeshFileEntry> entries(meshes.size());
+    size_t offset = align16(sizeof(header) + sizeof(MeshFileMaterial) * file_materials.size() + sizeof(MeshFileEntry) * entries.size());
+    for (size_t i = 0; i < meshes.size(); i++) {
+        MeshFileEntry& entry = entries[i];
+        std::memset(&entry, 0, sizeof(entry));
+        entry.material = meshes[i].material;
+        entry.vertex_count = meshes[i].vertices.size() / MESH_VERTEX_FLOATS;
+        entry.index_count = meshes[i].indices.size();
+        entry.vertex_offset = offset;
+        offset = align16(offset + sizeof(float) * meshes[i].vertices.size());
+        entry.index_offset = offset;
+        offset = align16(offset + sizeof(uint32_t) * meshes[i].indices.size());
+
+        for (int j = 0; j < 3; j++) {
+            entry.bounds_min[j] = 1e30f;
+            entry.bounds_max[j] = -1e30f;
+        }
+        for (size_t v = 0; v < meshes[i].vertices.size(); v += MESH_VERTEX_FLOATS) {
+            grow_bounds(entry.bounds_min, entry.bounds_max, &meshes[i].vertices[v]);
+        }
+        grow_bounds(header.bounds_min, header.bounds_max, entry.bounds_min);
+        grow_bounds(header.bounds_min, header.bounds_max, entry.bounds_max);
+    }
+
+    make_cache_directory(CACHE_DIR);
+    // written under a temporary name so a crash never leaves a truncated file
+    std::string tmp_filename = mesh_filename + ".tmp";
+    {
+        std::ofstream file(tmp_filename, std::ios::binary);
+        file.write((const char*)&header, sizeof(header));
+        file.write((const char*)file_materials.data(), sizeof(MeshFileMaterial) * file_materials.size());
+        file.write((const char*)entries.data(), sizeof(MeshFileEntry) * entries.size());
+        for (size_t i = 0; i < meshes.size(); i++) {
+            file.seekp(entries[i].vertex_offset);
+            file.write((const char*)meshes[i].vertices.data(), sizeof(float) * meshes[i].vertices.size());
+            file.seekp(entries[i].index_offset);
+            file.write((const char*)meshes[i].indices.data(), sizeof(uint32_t) * meshes[i].indices.size());
+        }
+        if (!file) {
+            std::cerr << "failed to write " << tmp_filename << std::endl;
+            return false;
+        }
+    }
+    std::remove(mesh_filename.c_str());
+    return std::rename(tmp_filename.c_str(), mesh_filename.c_str()) == 0;
+}
+
+bool MeshFile::open(const std::string& mesh_filename, const std::string& source_filename) {
+    if (!file.open(mesh_filename))
+        return false;
+    data = file.data();
+    if (!valid()) {
+        close();
+        return false;
+    }
+    uint64_t source_size;
+    int64_t source_mtime;
+    if (!source_filename.empty() && source_stat(source_filename, source_size, source_mtime)
+        && (source_size != header().source_size || source_mtime != header().source_mtime)) {
+        close();
+        return false;
+    }
+    return true;
+}
+
+void MeshFile::close() {
+    file.close();
+    data = nullptr;
+}
+
+const MeshFileMaterial& MeshFile::material(size_t i) const {
+    return ((const MeshFileMaterial*)(data + sizeof(MeshFileHeader)))[i];
+}
+
+const MeshFileEntry& MeshFile::mesh(size_t i) const {
+    const unsigned char* table = data + sizeof(MeshFileHeader) + sizeof(MeshFileMaterial) * header().material_count;
+    return ((const MeshFileEntry*)table)[i];
+}
+
+bool MeshFile::valid() const {
+    const size_t size = file.size();
+    if (size < sizeof(MeshFileHeader) || header().magic != MESH_FILE_MAGIC || header().version != MESH_FILE_VERSION)
+        return false;
+    size_t tables_end = sizeof(MeshFileHeader) + sizeof(MeshFileMaterial) * header().material_count + sizeof(MeshFileEntry) * header().mesh_count;
+    if (tables_end > size)
+        return false;
+    for (size_t i = 0; i < header().mesh_count; i++) {
+        const MeshFileEntry& entry = mesh(i);
+        if (entry.vertex_offset + sizeof(float) * MESH_VERTEX_FLOATS * entry.vertex_count > size
+            || entry.index_offset + sizeof(uint32_t) * entry.index_count > size)
+            return false;
+        if (entry.material != NO_MATERIAL && entry.material >= header().material_count)
+            return false;
+    }
+    return true;
+}
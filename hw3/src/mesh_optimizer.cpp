@@ -0,0 +1,344 @@
+#include "mesh_optimizer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace {
+// LRU size the vertex cache order is tuned for
+const int OPTIMIZE_CACHE_SIZE = 32;
+// FIFO size of the analysis and of the cluster split
+const uint32_t FIFO_CACHE_SIZE = 16;
+
+// Forsyth's scoring constants
+const float CACHE_DECAY_POWER = 1.5f;
+const float LAST_TRIANGLE_SCORE = 0.75f;
+const float VALENCE_BOOST_SCALE = 2.0f;
+const float VALENCE_BOOST_POWER = 0.5f;
+
+const int OVERDRAW_GRID = 256;
+
+float vertex_score(int cache_position, uint32_t remaining_triangles) {
+    if (remaining_triangles == 0)
+        return -1;
+
+    float score = 0;
+    if (cache_position >= 0) {
+        // the last triangle's vertices get a fixed score so the next one does not just reuse an edge of it
+        if (cache_position < 3)
+            score = LAST_TRIANGLE_SCORE;
+        else
+            score = std::pow(1 - float(cache_position - 3) / (OPTIMIZE_CACHE_SIZE - 3), CACHE_DECAY_POWER);
+    }
+    // vertices with few triangles left are finished first, so they leave the cache for good
+    return score + VALENCE_BOOST_SCALE * std::pow(float(remaining_triangles), -VALENCE_BOOST_POWER);
+}
+
+void sub(const float* a, const float* b, float* out) {
+    for (int i = 0; i < 3; i++) {
+        out[i] = a[i] - b[i];
+    }
+}
+
+void cross(const float* a, const float* b, float* out) {
+    out[0] = a[1] * b[2] - a[2] * b[1];
+    out[1] = a[2] * b[0] - a[0] * b[2];
+    out[2] = a[0] * b[1] - a[1] * b[0];
+}
+
+float length(const float* a) {
+    return std::sqrt(a[0] * a[0] + a[1] * a[1] + a[2] * a[2]);
+}
+
+// one orthographic view along an axis: depth test only, no culling since the winding is not known
+void rasterize_view(const std::vector<uint32_t>& indices, const std::vector<float>& vertices, size_t stride,
+                    int axis, float sign, const float* bounds_min, float scale, size_t& shaded, size_t& covered) {
+    const int u_axis = (axis + 1) % 3, v_axis = (axis + 2) % 3;
+    std::vector<float> depth_buffer(OVERDRAW_GRID * OVERDRAW_GRID, std::numeric_limits<float>::max());
+
+    for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+        float x[3], y[3], z[3];
+        for (int k = 0; k < 3; k++) {
+            const float* p = &vertices[stride * indices[i + k]];
+            x[k] = (p[u_axis] - bounds_min[u_axis]) * scale;
+            y[k] = (p[v_axis] - bounds_min[v_axis]) * scale;
+            z[k] = sign * p[axis];
+        }
+        float area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+        if (area == 0)
+            continue;
+
+        int min_x = std::max(0, int(std::floor(std::min({ x[0], x[1], x[2] }))));
+        int max_x = std::min(OVERDRAW_GRID - 1, int(std::ceil(std::max({ x[0], x[1], x[2] }))));
+        int min_y = std::max(0, int(std::floor(std::min({ y[0], y[1], y[2] }))));
+        int max_y = std::min(OVERDRAW_GRID - 1, int(std::ceil(std::max({ y[0], y[1], y[2] }))));
+        for (int py = min_y; py <= max_y; py++) {
+            for (int px = min_x; px <= max_x; px++) {
+                float cx = px + 0.5f, cy = py + 0.5f;
+                // barycentrics, the sign of the area makes them positive inside for both windings
+                float w0 = ((x[1] - cx) * (y[2] - cy) - (x[2] - cx) * (y[1] - cy)) / area;
+                float w1 = ((x[2] - cx) * (y[0] - cy) - (x[0] - cx) * (y[2] - cy)) / area;
+                float w2 = 1 - w0 - w1;
+                if (w0 < 0 || w1 < 0 || w2 < 0)
+                    continue;
+                float depth = w0 * z[0] + w1 * z[1] + w2 * z[2];
+                float& stored = depth_buffer[py * OVERDRAW_GRID + px];
+                if (depth < stored) {
+                    if (stored == std::numeric_limits<float>::max())
+                        covered++;
+                    stored = depth;
+                    shaded++;
+                }
+            }
+        }
+    }
+}
+}
+
+void optimize_vertex_cache(std::vector<uint32_t>& indices, size_t vertex_count) {
+    const size_t triangle_count = indices.size() / 3;
+    if (triangle_count == 0)
+        return;
+
+    // triangles of every vertex in one array, the first remaining[v] of a vertex are not emitted yet
+    std::vector<uint32_t> remaining(vertex_count, 0);
+    for (uint32_t index : indices) {
+        remaining[index]++;
+    }
+    std::vector<uint32_t> offsets(vertex_count + 1, 0);
+    for (size_t v = 0; v < vertex_count; v++) {
+        offsets[v + 1] = offsets[v] + remaining[v];
+    }
+    std::vector<uint32_t> adjacency(indices.size());
+    {
+        std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+        for (size_t t = 0; t < triangle_count; t++) {
+            for (int k = 0; k < 3; k++) {
+                adjacency[fill[indices[3 * t + k]]++] = t;
+            }
+        }
+    }
+
+    std::vector<int> cache_position(vertex_count, -1);
+    std::vector<float> scores(vertex_count);
+    for (size_t v = 0; v < vertex_count; v++) {
+        scores[v] = vertex_score(-1, remaining[v]);
+    }
+    std::vector<bool> emitted(triangle_count, false);
+
+    std::vector<uint32_t> cache, new_cache;
+    std::vector<uint32_t> result;
+    result.reserve(indices.size());
+
+    size_t input_cursor = 0;
+    long best = -1;
+    while (result.size() < 3 * triangle_count) {
+        // nothing adjacent to the cache is left, continue in input order
+        if (best == -1) {
+            while (emitted[input_cursor])
+                input_cursor++;
+            best = input_cursor;
+        }
+        emitted[best] = true;
+        const uint32_t* triangle = &indices[3 * best];
+        result.insert(result.end(), triangle, triangle + 3);
+
+        new_cache.clear();
+        for (int k = 0; k < 3; k++) {
+            uint32_t v = triangle[k];
+            auto begin = adjacency.begin() + offsets[v];
+            auto end = begin + remaining[v];
+            auto it = std::find(begin, end, uint32_t(best));
+            if (it != end) {
+                *it = *(end - 1);
+                remaining[v]--;
+            }
+            if (std::find(new_cache.begin(), new_cache.end(), v) == new_cache.end())
+                new_cache.push_back(v);
+        }
+        // the triangle moves to the front, the rest of the cache shifts back
+        const size_t triangle_vertices = new_cache.size();
+        for (uint32_t v : cache) {
+            if (std::find(new_cache.begin(), new_cache.begin() + triangle_vertices, v) == new_cache.begin() + triangle_vertices)
+                new_cache.push_back(v);
+        }
+
+        // vertices pushed out of the cache lose their cache score too
+        for (size_t i = 0; i < new_cache.size(); i++) {
+            uint32_t v = new_cache[i];
+            cache_position[v] = i < OPTIMIZE_CACHE_SIZE ? int(i) : -1;
+            scores[v] = vertex_score(cache_position[v], remaining[v]);
+        }
+
+        // the best triangle touching the cache goes next
+        best = -1;
+        float best_score = -1;
+        for (uint32_t v : new_cache) {
+            for (uint32_t i = offsets[v]; i < offsets[v] + remaining[v]; i++) {
+                uint32_t t = adjacency[i];
+                float score = scores[indices[3 * t]] + scores[indices[3 * t + 1]] + scores[indices[3 * t + 2]];
+                if (score > best_score) {
+                    best_score = score;
+                    best = t;
+                }
+            }
+        }
+
+        if (new_cache.size() > OPTIMIZE_CACHE_SIZE)
+            new_cache.resize(OPTIMIZE_CACHE_SIZE);
+        cache.swap(new_cache);
+    }
+    indices.swap(result);
+}
+
+void optimize_overdraw(std::vector<uint32_t>& indices, const std::vector<float>& vertices, size_t stride) {
+    const size_t triangle_count = indices.size() / 3;
+    const size_t vertex_count = vertices.size() / stride;
+    if (triangle_count == 0)
+        return;
+
+    // a triangle missing the cache with all three vertices is where the cache order jumped
+    std::vector<size_t> cluster_starts;
+    std::vector<uint32_t> cache_time(vertex_count, 0);
+    uint32_t time = FIFO_CACHE_SIZE + 1;
+    for (size_t t = 0; t < triangle_count; t++) {
+        int misses = 0;
+        for (int k = 0; k < 3; k++) {
+            uint32_t v = indices[3 * t + k];
+            if (time - cache_time[v] > FIFO_CACHE_SIZE) {
+                cache_time[v] = time++;
+                misses++;
+            }
+        }
+        if (t == 0 || misses == 3)
+            cluster_starts.push_back(t);
+    }
+    cluster_starts.push_back(triangle_count);
+
+    float mesh_centroid[3] = { 0, 0, 0 };
+    for (uint32_t index : indices) {
+        for (int i = 0; i < 3; i++) {
+            mesh_centroid[i] += vertices[stride * index + i] / indices.size();
+        }
+    }
+
+    // clusters whose surface faces away from the center are in front of the rest from most directions
+    struct Cluster {
+        size_t start, end;
+        float key;
+    };
+    std::vector<Cluster> clusters;
+    for (size_t c = 0; c + 1 < cluster_starts.size(); c++) {
+        float centroid[3] = { 0, 0, 0 }, normal[3] = { 0, 0, 0 };
+        float area_sum = 0;
+        for (size_t t = cluster_starts[c]; t < cluster_starts[c + 1]; t++) {
+            const float* p[3];
+            for (int k = 0; k < 3; k++) {
+                p[k] = &vertices[stride * indices[3 * t + k]];
+            }
+            float e1[3], e2[3], n[3];
+            sub(p[1], p[0], e1);
+            sub(p[2], p[0], e2);
+            cross(e1, e2, n);
+            float area = length(n);
+            area_sum += area;
+            for (int i = 0; i < 3; i++) {
+                centroid[i] += area * (p[0][i] + p[1][i] + p[2][i]) / 3;
+                // the stored normals give the outside, the winding of OBJ files can not be trusted
+                normal[i] += area * (p[0][3 + i] + p[1][3 + i] + p[2][3 + i]);
+            }
+        }
+
+        float key = 0;
+        float normal_length = length(normal);
+        if (area_sum > 0 && normal_length > 0) {
+            for (int i = 0; i < 3; i++) {
+                key += (centroid[i] / area_sum - mesh_centroid[i]) * normal[i] / normal_length;
+            }
+        }
+        clusters.push_back({ cluster_starts[c], cluster_starts[c + 1], key });
+    }
+    std::stable_sort(clusters.begin(), clusters.end(), [](const Cluster& a, const Cluster& b) { return a.key > b.key; });
+
+    std::vector<uint32_t> result;
+    result.reserve(indices.size());
+    for (const Cluster& cluster : clusters) {
+        result.insert(result.end(), indices.begin() + 3 * cluster.start, indices.begin() + 3 * cluster.end);
+    }
+    indices.swap(result);
+}
+
+void optimize_vertex_fetch(std::vector<float>& vertices, size_t stride, std::vector<uint32_t>& indices) {
+    const uint32_t unused = std::numeric_limits<uint32_t>::max();
+    std::vector<uint32_t> remap(vertices.size() / stride, unused);
+    uint32_t next = 0;
+    for (uint32_t& index : indices) {
+        if (remap[index] == unused)
+            remap[index] = next++;
+        index = remap[index];
+    }
+
+    // vertices no triangle uses are dropped
+    std::vector<float> result(size_t(next) * stride);
+    for (size_t v = 0; v < remap.size(); v++) {
+        if (remap[v] != unused)
+            std::copy_n(&vertices[v * stride], stride, &result[remap[v] * stride]);
+    }
+    vertices.swap(result);
+}
+
+void optimize_mesh(std::vector<float>& vertices, size_t stride, std::vector<uint32_t>& indices) {
+    optimize_vertex_cache(indices, vertices.size() / stride);
+    optimize_overdraw(indices, vertices, stride);
+    optimize_vertex_fetch(vertices, stride, indices);
+}
+
+VertexCacheStats analyze_vertex_cache(const std::vector<uint32_t>& indices, size_t vertex_count) {
+    std::vector<uint32_t> cache_time(vertex_count, 0);
+    std::vector<bool> used(vertex_count, false);
+    uint32_t time = FIFO_CACHE_SIZE + 1;
+    size_t misses = 0, unique = 0;
+    for (uint32_t index : indices) {
+        if (time - cache_time[index] > FIFO_CACHE_SIZE) {
+            cache_time[index] = time++;
+            misses++;
+        }
+        if (!used[index]) {
+            used[index] = true;
+            unique++;
+        }
+    }
+
+    VertexCacheStats stats;
+    stats.acmr = indices.empty() ? 0 : float(misses) / (indices.size() / 3);
+    stats.atvr = unique == 0 ? 0 : float(misses) / unique;
+    return stats;
+}
+
+float analyze_overdraw(const std::vector<uint32_t>& indices, const std::vector<float>& vertices, size_t stride) {
+    if (indices.empty())
+        return 0;
+
+    float bounds_min[3], bounds_max[3];
+    for (int i = 0; i < 3; i++) {
+        bounds_min[i] = std::numeric_limits<float>::max();
+        bounds_max[i] = -std::numeric_limits<float>::max();
+    }
+    for (uint32_t index : indices) {
+        for (int i = 0; i < 3; i++) {
+            bounds_min[i] = std::min(bounds_min[i], vertices[stride * index + i]);
+            bounds_max[i] = std::max(bounds_max[i], vertices[stride * index + i]);
+        }
+    }
+    float extent = std::max({ bounds_max[0] - bounds_min[0], bounds_max[1] - bounds_min[1], bounds_max[2] - bounds_min[2] });
+    if (extent <= 0)
+        return 0;
+    float scale = (OVERDRAW_GRID - 1) / extent;
+
+    size_t shaded = 0, covered = 0;
+    for (int axis = 0; axis < 3; axis++) {
+        rasterize_view(indices, vertices, stride, axis, 1, bounds_min, scale, shaded, covered);
+        rasterize_view(indices, vertices, stride, axis, -1, bounds_min, scale, shaded, covered);
+    }
+    return covered == 0 ? 0 : float(shaded) / covered;
+}
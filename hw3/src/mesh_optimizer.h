@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Bake time reordering of indexed triangle lists, GL free so mesh-baker uses it too.
+// vertices are interleaved with `stride` floats per vertex, position then normal
+
+// Tom Forsyth's linear-speed vertex cache optimisation, tuned for a 32 entry LRU cache
+void optimize_vertex_cache(std::vector<uint32_t>& indices, size_t vertex_count);
+
+// Splits the cache optimized order into clusters where it jumped to a new area of the mesh and draws
+// outward facing clusters first, so early-z rejects more of the rest. Order within clusters is kept
+void optimize_overdraw(std::vector<uint32_t>& indices, const std::vector<float>& vertices, size_t stride);
+
+// Renumbers vertices in the order the index buffer first uses them, so fetches walk the buffer linearly
+void optimize_vertex_fetch(std::vector<float>& vertices, size_t stride, std::vector<uint32_t>& indices);
+
+// all three above, in that order
+void optimize_mesh(std::vector<float>& vertices, size_t stride, std::vector<uint32_t>& indices);
+
+struct VertexCacheStats {
+    // transformed vertices per triangle, 0.5 is the limit for regular grids, 3 means no reuse at all
+    float acmr;
+    // transformed vertices per unique vertex, 1 is ideal
+    float atvr;
+};
+
+// simulates a 16 entry FIFO post-transform cache, smaller than the one optimized for like most hardware
+VertexCacheStats analyze_vertex_cache(const std::vector<uint32_t>& indices, size_t vertex_count);
+
+// Shaded pixels per covered pixel with depth testing, rasterized in software from the 6 axis directions.
+// 1 means every pixel was shaded once
+float analyze_overdraw(const std::vector<uint32_t>& indices, const std::vector<float>& vertices, size_t stride);
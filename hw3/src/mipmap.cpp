@@ -0,0 +1,135 @@
+#include "mipmap.h"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__SSE__) || defined(_M_X64) || defined(_M_AMD64)
+#include <xmmintrin.h>
+#define MIPMAP_SSE
+#endif
+
+#include "parallel.h"
+
+namespace {
+// GAMMA in object.fs and moon.fs
+const float GAMMA = 2.2f;
+// linear values are quantized this finely before encoding, enough to keep every dark byte value apart
+const int LINEAR_STEPS = 65536;
+// output rows per parallel_for item
+const int ROWS_PER_BLOCK = 32;
+
+struct GammaTables {
+    float to_linear[256];
+    unsigned char to_gamma[LINEAR_STEPS];
+    // data textures, bytes to [0, 1] and back without the curve
+    float to_unit[256];
+    unsigned char from_unit[LINEAR_STEPS];
+
+    GammaTables() {
+        for (int i = 0; i < 256; i++) {
+            to_linear[i] = std::pow(i / 255.0f, GAMMA);
+            to_unit[i] = i / 255.0f;
+        }
+        for (int i = 0; i < LINEAR_STEPS; i++) {
+            to_gamma[i] = (unsigned char)std::lround(std::pow(i / float(LINEAR_STEPS - 1), 1 / GAMMA) * 255);
+            from_unit[i] = (unsigned char)std::lround(i / float(LINEAR_STEPS - 1) * 255);
+        }
+    }
+};
+
+const GammaTables& gamma_tables() {
+    static const GammaTables tables;
+    return tables;
+}
+
+// source texels of one output texel when halving a size, odd sizes spread 3 texels over every output
+struct Taps {
+    int first;
+    int count;
+    float weights[3];
+};
+
+Taps box_taps(int x, int in_size, int out_size) {
+    if (in_size == 1)
+        return { 0, 1, { 1, 0, 0 } };
+    if (in_size % 2 == 0)
+        return { 2 * x, 2, { 0.5f, 0.5f, 0 } };
+    float n = in_size;
+    return { 2 * x, 3, { (out_size - x) / n, out_size / n, (x + 1) / n } };
+}
+
+// dst += weight * src
+void add_scaled(float* dst, const float* src, float weight, size_t count) {
+    size_t i = 0;
+#ifdef MIPMAP_SSE
+    __m128 w = _mm_set1_ps(weight);
+    for (; i + 4 <= count; i += 4) {
+        _mm_storeu_ps(dst + i, _mm_add_ps(_mm_loadu_ps(dst + i), _mm_mul_ps(_mm_loadu_ps(src + i), w)));
+    }
+#endif
+    for (; i < count; i++) {
+        dst[i] += weight * src[i];
+    }
+}
+
+void downsample_rows(const unsigned char* in, int in_width, int in_height, MipLevel& out, int first_row, int end_row, bool color) {
+    const GammaTables& tables = gamma_tables();
+    const float* decode = color ? tables.to_linear : tables.to_unit;
+    const unsigned char* encode = color ? tables.to_gamma : tables.from_unit;
+    const size_t in_row = 3 * size_t(in_width);
+    std::vector<float> decoded(in_row), column(in_row);
+
+    for (int y = first_row; y < end_row; y++) {
+        // vertical pass over whole rows, then horizontal within the row
+        Taps ty = box_taps(y, in_height, out.height);
+        std::fill(column.begin(), column.end(), 0.0f);
+        for (int t = 0; t < ty.count; t++) {
+            const unsigned char* row = in + in_row * (ty.first + t);
+            for (size_t i = 0; i < in_row; i++) {
+                decoded[i] = decode[row[i]];
+            }
+            add_scaled(column.data(), decoded.data(), ty.weights[t], in_row);
+        }
+
+        unsigned char* out_row = &out.pixels[3 * size_t(out.width) * y];
+        for (int x = 0; x < out.width; x++) {
+            Taps tx = box_taps(x, in_width, out.width);
+            for (int c = 0; c < 3; c++) {
+                float sum = 0;
+                for (int t = 0; t < tx.count; t++) {
+                    sum += tx.weights[t] * column[3 * (tx.first + t) + c];
+                }
+                int step = std::min(LINEAR_STEPS - 1, std::max(0, int(sum * (LINEAR_STEPS - 1) + 0.5f)));
+                out_row[3 * x + c] = encode[step];
+            }
+        }
+    }
+}
+}
+
+std::vector<MipLevel> generate_mipmaps(const unsigned char* image, int width, int height, bool color) {
+    std::vector<MipLevel> levels;
+    // every level is filtered from the one before, so they must not move
+    levels.reserve(32);
+    const unsigned char* in = image;
+    int in_width = width, in_height = height;
+
+    while (in_width > 1 || in_height > 1) {
+        levels.emplace_back();
+        MipLevel& out = levels.back();
+        out.width = std::max(1, in_width / 2);
+        out.height = std::max(1, in_height / 2);
+        out.pixels.resize(3 * size_t(out.width) * out.height);
+
+        size_t block_count = (out.height + ROWS_PER_BLOCK - 1) / ROWS_PER_BLOCK;
+        parallel_for(block_count, [&](size_t block) {
+            int first_row = block * ROWS_PER_BLOCK;
+            downsample_rows(in, in_width, in_height, out, first_row, std::min(out.height, first_row + ROWS_PER_BLOCK), color);
+        });
+
+        in = out.pixels.data();
+        in_width = out.width;
+        in_height = out.height;
+    }
+    return levels;
+}
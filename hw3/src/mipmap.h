@@ -0,0 +1,16 @@
+#pragma once
+
+#include <vector>
+
+struct MipLevel {
+    int width;
+    int height;
+    // RGB8, rows tightly packed
+    std::vector<unsigned char> pixels;
+};
+
+// Mip levels 1 and up, to 1x1, of an RGB8 image. Color texels are gamma encoded like the fragment shaders
+// assume (GAMMA 2.2) and averaged in linear space, so a level is as bright as the one above it. Data such as
+// masks (color false) is averaged as the bytes are.
+// Box filter with 3 taps along odd sizes; GL free, rows of large levels are filtered on several threads
+std::vector<MipLevel> generate_mipmaps(const unsigned char* image, int width, int height, bool color = true);
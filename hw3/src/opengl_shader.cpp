@@ -1,148 +1,386 @@
 #include "opengl_shader.h"
 
-#include <fstream>
-#include <sstream>
+#include <algorithm>
+#include <cstring>
 #include <iostream>
 
 #include <glm/glm.hpp>
+#include <glm/gtc/type_ptr.hpp>
 
-namespace
-{
-   std::string read_file(const std::string &fname)
-   {
-      std::stringstream file_stream;
-      try
-      {
-         std::ifstream file(fname.c_str());
-         file_stream << file.rdbuf();
-      }
-      catch (std::exception const & e)
-      {
-         std::cerr << "Error reading shader file: " << e.what() << std::endl;
-      }
-      
-      return file_stream.str();
-
-   }
-
-   std::string read_shader_code(const std::string &fname) {
-      std::string file_content = read_file(fname);
-
-      std::string myinclude_text = "#myinclude_light";
-      auto spos = file_content.find(myinclude_text);
-      if (spos != std::string::npos) {
-          std::string lighting = read_file("assets/light.fs");
-          file_content = file_content.replace(spos, myinclude_text.size(), lighting);
-      }
-
-      return file_content;
-   }
-}
+#include "gl_state.h"
+#include "program_cache.h"
+#include "uniform_blocks.h"
+
+uniform_upload_stats shader_t::upload_stats;
 
 shader_t::shader_t(const std::string& vertex_code_fname, const std::string& fragment_code_fname)
-{
-   const auto vertex_code = read_shader_code(vertex_code_fname);
-   const auto fragment_code = read_shader_code(fragment_code_fname);
-   compile(vertex_code, fragment_code);
-   link();
+    : vertex_fname_(vertex_code_fname)
+    , fragment_fname_(fragment_code_fname) {
+    build();
+}
+
+shader_t::shader_t(const std::string& vertex_code_fname, const std::string& fragment_code_fname, const std::string& geometry_code_fname)
+    : vertex_fname_(vertex_code_fname)
+    , fragment_fname_(fragment_code_fname)
+    , geometry_fname_(geometry_code_fname) {
+    build();
+}
+
+shader_t::shader_t(const std::string& vertex_code_fname, const std::string& fragment_code_fname, const std::string& geometry_code_fname, const std::vector<std::string>& defines)
+    : vertex_fname_(vertex_code_fname)
+    , fragment_fname_(fragment_code_fname)
+    , geometry_fname_(geometry_code_fname)
+    , defines_(defines) {
+    build();
+}
+
+shader_t::shader_t(const std::string& vertex_code_fname, const std::vector<std::string>& feedback_varyings)
+    : vertex_fname_(vertex_code_fname)
+    , feedback_varyings_(feedback_varyings) {
+    build();
 }
 
 shader_t::~shader_t() {
 }
 
-void shader_t::compile(const std::string& vertex_code, const std::string& fragment_code)
-{
-   const char* vcode = vertex_code.c_str();
-   vertex_id_ = glCreateShader(GL_VERTEX_SHADER);
-   glShaderSource(vertex_id_, 1, &vcode, NULL);
-   glCompileShader(vertex_id_);
+void shader_t::build() {
+    create_program();
+    cache_locations();
+    bind_uniform_blocks();
+}
+
+bool shader_t::reload() {
+    GLuint old_program_id = program_id_;
+    if (!create_program()) {
+        gl_state::forget_program(program_id_);
+        glDeleteProgram(program_id_);
+        program_id_ = old_program_id;
+        return false;
+    }
+    gl_state::forget_program(old_program_id);
+    glDeleteProgram(old_program_id);
+    cache_locations();
+    bind_uniform_blocks();
+    restore_uniforms();
+    return true;
+}
+
+bool shader_t::create_program() {
+    vertex_source_ = preprocess_shader(vertex_fname_, defines_);
+    fragment_source_ = fragment_fname_.empty() ? ShaderSource() : preprocess_shader(fragment_fname_, defines_);
+    geometry_source_ = geometry_fname_.empty() ? ShaderSource() : preprocess_shader(geometry_fname_, defines_);
+
+    dependencies_.clear();
+    for (const ShaderSource* source : { &vertex_source_, &fragment_source_, &geometry_source_ }) {
+        for (const std::string& file : source->files) {
+            if (std::find(dependencies_.begin(), dependencies_.end(), file) == dependencies_.end())
+                dependencies_.push_back(file);
+        }
+    }
+
+    program_id_ = glCreateProgram();
+
+    std::vector<std::string> key_parts = { vertex_source_.code, fragment_source_.code, geometry_source_.code };
+    key_parts.insert(key_parts.end(), feedback_varyings_.begin(), feedback_varyings_.end());
+    const std::string cache_key = program_cache_key(key_parts);
+
+    if (load_program_binary(program_id_, cache_key))
+        return true;
+    compile();
+    if (!link())
+        return false;
+    save_program_binary(program_id_, cache_key);
+    return true;
+}
+
+void shader_t::compile() {
+    auto compile_stage = [](GLenum type, const ShaderSource& source) -> GLuint {
+        // transform feedback programs have no fragment stage
+        if (source.code.empty())
+            return -1;
+        const char* code = source.code.c_str();
+        GLuint id = glCreateShader(type);
+        glShaderSource(id, 1, &code, NULL);
+        glCompileShader(id);
+        return id;
+    };
+    vertex_id_ = compile_stage(GL_VERTEX_SHADER, vertex_source_);
+    fragment_id_ = compile_stage(GL_FRAGMENT_SHADER, fragment_source_);
+    geometry_id_ = compile_stage(GL_GEOMETRY_SHADER, geometry_source_);
+    check_compile_error();
+}
+
+bool shader_t::link() {
+    glAttachShader(program_id_, vertex_id_);
+    if (fragment_id_ != -1)
+        glAttachShader(program_id_, fragment_id_);
+    if (geometry_id_ != -1)
+        glAttachShader(program_id_, geometry_id_);
 
-   const char* fcode = fragment_code.c_str();
-   fragment_id_ = glCreateShader(GL_FRAGMENT_SHADER);
-   glShaderSource(fragment_id_, 1, &fcode, NULL);
-   glCompileShader(fragment_id_);
-   check_compile_error();
+    if (!feedback_varyings_.empty()) {
+        std::vector<const GLchar*> varyings;
+        for (const std::string& varying : feedback_varyings_) {
+            varyings.push_back(varying.c_str());
+        }
+        glTransformFeedbackVaryings(program_id_, varyings.size(), varyings.data(), GL_INTERLEAVED_ATTRIBS);
+    }
+    if (program_binary_supported())
+        glProgramParameteri(program_id_, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+
+    glLinkProgram(program_id_);
+    bool linked = check_linking_error();
+    glDeleteShader(vertex_id_);
+    if (fragment_id_ != -1)
+        glDeleteShader(fragment_id_);
+    if (geometry_id_ != -1)
+        glDeleteShader(geometry_id_);
+    return linked;
 }
 
-void shader_t::link() {
-   program_id_ = glCreateProgram();
-   glAttachShader(program_id_, vertex_id_);
-   glAttachShader(program_id_, fragment_id_);
-   glLinkProgram(program_id_);
-   check_linking_error();
-   glDeleteShader(vertex_id_);
-   glDeleteShader(fragment_id_);
+void shader_t::bind_uniform_blocks() {
+    GLint block_count = 0;
+    glGetProgramiv(program_id_, GL_ACTIVE_UNIFORM_BLOCKS, &block_count);
+    for (GLint i = 0; i < block_count; i++) {
+        char name[256];
+        glGetActiveUniformBlockName(program_id_, i, sizeof(name), NULL, name);
+        const UniformBlockInfo* block = find_uniform_block(name);
+        if (block == NULL) {
+            std::cerr << "unknown uniform block " << name << std::endl;
+            continue;
+        }
+
+        GLint size = 0;
+        glGetActiveUniformBlockiv(program_id_, i, GL_UNIFORM_BLOCK_DATA_SIZE, &size);
+        // the driver may leave out the tail padding, a bigger block means the mirror is out of date
+        if (size_t(size) > block->size) {
+            std::cerr << "uniform block " << name << " is " << size << " bytes, C++ mirror is " << block->size << std::endl;
+        }
+        glUniformBlockBinding(program_id_, i, block->binding);
+    }
+}
+
+void shader_t::cache_locations() {
+    // handles hold slots, so a relink only updates the locations behind them
+    std::fill(uniform_locations_.begin(), uniform_locations_.end(), -1);
+
+    GLint uniform_count = 0;
+    glGetProgramiv(program_id_, GL_ACTIVE_UNIFORMS, &uniform_count);
+    GLint max_name_length = 0;
+    glGetProgramiv(program_id_, GL_ACTIVE_UNIFORM_MAX_LENGTH, &max_name_length);
+
+    std::vector<char> name_buffer(max_name_length + 1);
+    for (GLint i = 0; i < uniform_count; i++) {
+        GLsizei name_length;
+        GLint size;
+        GLenum type;
+        glGetActiveUniform(program_id_, i, name_buffer.size(), &name_length, &size, &type, &name_buffer[0]);
+        std::string name(&name_buffer[0], name_length);
+
+        // arrays are reported as "name[0]" and can be set as a whole by "name"
+        std::string base_name = name;
+        if (name.size() > 3 && name.compare(name.size() - 3, 3, "[0]") == 0) {
+            base_name = name.substr(0, name.size() - 3);
+        }
+        int slot = get_slot(base_name);
+        uniform_locations_[slot] = glGetUniformLocation(program_id_, base_name.c_str());
+        uniform_types_[slot] = type;
+
+        // "name" and "name[0]" are the same location, they share a slot so the shadow value stays right
+        if (base_name != name)
+            uniform_slots_[name] = slot;
+        for (GLint element = 1; element < size && base_name != name; element++) {
+            std::string element_name = base_name + "[" + std::to_string(element) + "]";
+            int element_slot = get_slot(element_name);
+            uniform_locations_[element_slot] = glGetUniformLocation(program_id_, element_name.c_str());
+            uniform_types_[element_slot] = type;
+        }
+    }
+}
+
+void shader_t::restore_uniforms() {
+    gl_state::use_program(program_id_);
+    for (size_t slot = 0; slot < uniform_values_.size(); slot++) {
+        const uniform_value& value = uniform_values_[slot];
+        GLint location = uniform_locations_[slot];
+        if (location == -1 || value.size == 0)
+            continue;
+
+        const GLfloat* floats = (const GLfloat*)value.data;
+        switch (uniform_types_[slot]) {
+        case GL_FLOAT:
+            glUniform1fv(location, 1, floats);
+            break;
+        case GL_FLOAT_VEC2:
+            glUniform2fv(location, 1, floats);
+            break;
+        case GL_FLOAT_VEC3:
+            glUniform3fv(location, 1, floats);
+            break;
+        case GL_FLOAT_MAT4:
+            glUniformMatrix4fv(location, 1, GL_FALSE, floats);
+            break;
+        default:
+            // int, bool and sampler units
+            if (value.size == sizeof(GLint))
+                glUniform1iv(location, 1, (const GLint*)value.data);
+            break;
+        }
+    }
+}
+
+int shader_t::get_slot(const std::string& name) {
+    auto it = uniform_slots_.find(name);
+    if (it != uniform_slots_.end())
+        return it->second;
+
+    // inactive or misspelled uniforms get a slot too, setting it is a no-op like with location -1
+    int slot = uniform_locations_.size();
+    uniform_slots_[name] = slot;
+    uniform_locations_.push_back(-1);
+    uniform_types_.push_back(GL_NONE);
+    uniform_values_.emplace_back();
+    return slot;
+}
+
+bool shader_t::needs_upload(int slot, const void* data, size_t size) {
+    if (get_location(slot) == -1)
+        return false;
+
+    uniform_value& value = uniform_values_[slot];
+    if (size > sizeof(value.data)) {
+        value.size = 0;
+        upload_stats.issued++;
+        return true;
+    }
+    if (value.size == size && std::memcmp(value.data, data, size) == 0) {
+        upload_stats.skipped++;
+        return false;
+    }
+    value.size = size;
+    std::memcpy(value.data, data, size);
+    upload_stats.issued++;
+    return true;
 }
 
 void shader_t::use() {
-   glUseProgram(program_id_);
+    gl_state::use_program(program_id_);
+}
+
+template <>
+void shader_t::set_uniform<int>(uniform_handle<int> handle, int val) {
+    if (needs_upload(handle.slot_, &val, sizeof(val)))
+        glUniform1i(get_location(handle.slot_), val);
 }
 
-template<>
+template <>
+void shader_t::set_uniform<bool>(uniform_handle<bool> handle, bool val) {
+    // stored as int, so bool and int handles of one uniform share the shadow value
+    int ival = val;
+    if (needs_upload(handle.slot_, &ival, sizeof(ival)))
+        glUniform1i(get_location(handle.slot_), ival);
+}
+
+template <>
+void shader_t::set_uniform<float>(uniform_handle<float> handle, float val) {
+    if (needs_upload(handle.slot_, &val, sizeof(val)))
+        glUniform1f(get_location(handle.slot_), val);
+}
+
+template <>
+void shader_t::set_uniform<glm::vec2>(uniform_handle<glm::vec2> handle, glm::vec2 val) {
+    if (needs_upload(handle.slot_, &val.x, sizeof(val)))
+        glUniform2f(get_location(handle.slot_), val.x, val.y);
+}
+
+template <>
+void shader_t::set_uniform<glm::vec3>(uniform_handle<glm::vec3> handle, glm::vec3 val) {
+    if (needs_upload(handle.slot_, &val.x, sizeof(val)))
+        glUniform3f(get_location(handle.slot_), val.x, val.y, val.z);
+}
+
+template <>
+void shader_t::set_uniform<glm::mat4>(uniform_handle<glm::mat4> handle, glm::mat4 val) {
+    if (needs_upload(handle.slot_, glm::value_ptr(val), sizeof(val)))
+        glUniformMatrix4fv(get_location(handle.slot_), 1, GL_FALSE, glm::value_ptr(val));
+}
+
+template <>
 void shader_t::set_uniform<int>(const std::string& name, int val) {
-   glUniform1i(glGetUniformLocation(program_id_, name.c_str()), val);
+    set_uniform(get_handle<int>(name), val);
 }
 
-template<>
+template <>
 void shader_t::set_uniform<bool>(const std::string& name, bool val) {
-   glUniform1i(glGetUniformLocation(program_id_, name.c_str()), val);
+    set_uniform(get_handle<bool>(name), val);
 }
 
-template<>
+template <>
 void shader_t::set_uniform<float>(const std::string& name, float val) {
-   glUniform1f(glGetUniformLocation(program_id_, name.c_str()), val);
+    set_uniform(get_handle<float>(name), val);
 }
 
-template<>
+template <>
 void shader_t::set_uniform<float>(const std::string& name, float val1, float val2) {
-   glUniform2f(glGetUniformLocation(program_id_, name.c_str()), val1, val2);
+    set_uniform(get_handle<glm::vec2>(name), glm::vec2(val1, val2));
 }
 
-template<>
+template <>
 void shader_t::set_uniform<float>(const std::string& name, float val1, float val2, float val3) {
-   glUniform3f(glGetUniformLocation(program_id_, name.c_str()), val1, val2, val3);
+    set_uniform(get_handle<glm::vec3>(name), glm::vec3(val1, val2, val3));
 }
 
-template<>
+template <>
 void shader_t::set_uniform<float*>(const std::string& name, float* val) {
-   glUniformMatrix4fv(glGetUniformLocation(program_id_, name.c_str()), 1, GL_FALSE, val);
+    int slot = get_slot(name);
+    if (needs_upload(slot, val, 16 * sizeof(float)))
+        glUniformMatrix4fv(get_location(slot), 1, GL_FALSE, val);
 }
 
-template<>
+template <>
 void shader_t::set_uniform<glm::vec3>(const std::string& name, glm::vec3 val) {
-   glUniform3f(glGetUniformLocation(program_id_, name.c_str()), val.x, val.y, val.z);
+    set_uniform(get_handle<glm::vec3>(name), val);
 }
 
 // UNTESTED USE WITH CAUTION
-template<>
+template <>
 void shader_t::set_uniform<std::vector<glm::vec3>>(const std::string& name, std::vector<glm::vec3> vals) {
-   glUniform3fv(glGetUniformLocation(program_id_, name.c_str()), vals.size(), &vals[0].x);
+    // writes several elements, their shadow values are dropped instead of compared
+    for (size_t i = 0; i < vals.size(); i++) {
+        auto it = uniform_slots_.find(i == 0 ? name : name + "[" + std::to_string(i) + "]");
+        if (it != uniform_slots_.end())
+            uniform_values_[it->second].size = 0;
+    }
+    upload_stats.issued++;
+    glUniform3fv(get_location(get_slot(name)), vals.size(), &vals[0].x);
 }
 
 void shader_t::check_compile_error() {
-   int success;
-   char infoLog[1024];
-   glGetShaderiv(vertex_id_, GL_COMPILE_STATUS, &success);
-   if (!success)
-   {
-      glGetShaderInfoLog(vertex_id_, 1024, NULL, infoLog);
-      std::cerr << "Error compiling Vertex shader_t:\n" << infoLog << std::endl;
-   }
-   glGetShaderiv(fragment_id_, GL_COMPILE_STATUS, &success);
-   if (!success)
-   {
-      glGetShaderInfoLog(fragment_id_, 1024, NULL, infoLog);
-      std::cerr << "Error compiling Fragment shader_t:\n" << infoLog << std::endl;
-   }
-}
-
-void shader_t::check_linking_error() {
-   int success;
-   char infoLog[1024];
-   glGetProgramiv(program_id_, GL_LINK_STATUS, &success);
-   if (!success)
-   {
-      glGetProgramInfoLog(program_id_, 1024, NULL, infoLog);
-      std::cerr << "Error Linking shader_t Program:\n" << infoLog << std::endl;
-   }
+    auto check_stage = [](GLuint id, const char* stage, const ShaderSource& source) {
+        if (id == GLuint(-1))
+            return;
+        int success;
+        char infoLog[1024];
+        glGetShaderiv(id, GL_COMPILE_STATUS, &success);
+        if (!success) {
+            glGetShaderInfoLog(id, 1024, NULL, infoLog);
+            std::cerr << "Error compiling " << stage << " shader_t:\n"
+                      << infoLog << "file numbers in the log:\n"
+                      << source_legend(source) << std::endl;
+        }
+    };
+    check_stage(vertex_id_, "Vertex", vertex_source_);
+    check_stage(fragment_id_, "Fragment", fragment_source_);
+    check_stage(geometry_id_, "Geometry", geometry_source_);
+}
+
+bool shader_t::check_linking_error() {
+    int success;
+    char infoLog[1024];
+    glGetProgramiv(program_id_, GL_LINK_STATUS, &success);
+    if (!success) {
+        glGetProgramInfoLog(program_id_, 1024, NULL, infoLog);
+        std::cerr << "Error Linking shader_t Program:\n"
+                  << infoLog << std::endl;
+    }
+    return success;
 }
@@ -0,0 +1,201 @@
+#include "profiler.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <numeric>
+
+#include "imgui.h"
+
+namespace {
+float average(const std::vector<float>& values) {
+    if (values.empty())
+        return 0;
+    return std::accumulate(values.begin(), values.end(), 0.0f) / values.size();
+}
+
+// p in [0, 1], values are copied because the history is a ring buffer
+float percentile(std::vector<float> values, float p) {
+    if (values.empty())
+        return 0;
+    size_t k = std::min(values.size() - 1, size_t(p * values.size()));
+    std::nth_element(values.begin(), values.begin() + k, values.end());
+    return values[k];
+}
+}
+
+Profiler::Profiler(size_t history)
+    : history(history) {
+    for (FrameQueries& frame : frames) {
+        glGenQueries(MAX_PASSES, frame.queries);
+    }
+    frame_stats.name = "frame (cpu)";
+}
+
+Profiler::~Profiler() {
+    for (FrameQueries& frame : frames) {
+        glDeleteQueries(MAX_PASSES, frame.queries);
+    }
+}
+
+void Profiler::begin_frame() {
+    auto now = std::chrono::steady_clock::now();
+    if (frame_started) {
+        push(frame_stats.cpu_ms, frame_stats.cpu_next, std::chrono::duration<float, std::milli>(now - frame_start).count());
+    }
+    frame_started = true;
+    frame_start = now;
+
+    // the set about to be reused was issued FRAMES_IN_FLIGHT frames ago
+    frame_i = (frame_i + 1) % FRAMES_IN_FLIGHT;
+    collect(frames[frame_i]);
+}
+
+void Profiler::begin_pass(const char* name) {
+    if (in_pass) {
+        std::cerr << "profiler: pass " << name << " started inside " << passes[current_pass].name << std::endl;
+        end_pass();
+    }
+
+    current_pass = find_pass(name);
+    in_pass = true;
+    pass_start = std::chrono::steady_clock::now();
+
+    FrameQueries& frame = frames[frame_i];
+    if (frame.count < MAX_PASSES) {
+        frame.pass_ids[frame.count] = current_pass;
+        glBeginQuery(GL_TIME_ELAPSED, frame.queries[frame.count]);
+    }
+}
+
+void Profiler::end_pass() {
+    if (!in_pass)
+        return;
+    in_pass = false;
+
+    FrameQueries& frame = frames[frame_i];
+    if (frame.count < MAX_PASSES) {
+        glEndQuery(GL_TIME_ELAPSED);
+        frame.count++;
+    }
+
+    PassStats& pass = passes[current_pass];
+    push(pass.cpu_ms, pass.cpu_next, std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - pass_start).count());
+}
+
+void Profiler::counter(const char* name, size_t value) {
+    auto it = std::find_if(counters.begin(), counters.end(), [&](const Counter& c) { return c.name == name; });
+    if (it == counters.end()) {
+        counters.emplace_back();
+        counters.back().name = name;
+        it = counters.end() - 1;
+    }
+    it->last = value;
+    it->total += value;
+    it->frames++;
+}
+
+size_t Profiler::find_pass(const char* name) {
+    for (size_t i = 0; i < passes.size(); i++) {
+        if (passes[i].name == name)
+            return i;
+    }
+    passes.emplace_back();
+    passes.back().name = name;
+    return passes.size() - 1;
+}
+
+void Profiler::collect(FrameQueries& frame) {
+    if (frame.count > 0) {
+        // queries finish in order, so the last one being ready means all are
+        GLint available = 0;
+        glGetQueryObjectiv(frame.queries[frame.count - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (available) {
+            for (size_t i = 0; i < frame.count; i++) {
+                GLuint64 elapsed_ns;
+                glGetQueryObjectui64v(frame.queries[i], GL_QUERY_RESULT, &elapsed_ns);
+                PassStats& pass = passes[frame.pass_ids[i]];
+                push(pass.gpu_ms, pass.gpu_next, elapsed_ns / 1e6f);
+            }
+        } else {
+            dropped_frames++;
+        }
+    }
+    frame.count = 0;
+}
+
+void Profiler::push(std::vector<float>& values, size_t& next, float value) {
+    if (values.size() < history) {
+        values.push_back(value);
+    } else {
+        values[next] = value;
+    }
+    next = (next + 1) % history;
+}
+
+void Profiler::draw_imgui() {
+    if (!ImGui::CollapsingHeader("Profiler"))
+        return;
+
+    ImGui::Text("rolling %d frames, %d dropped gpu readbacks", int(history), int(dropped_frames));
+    ImGui::Columns(5, "profiler");
+    ImGui::Text("pass");
+    ImGui::NextColumn();
+    ImGui::Text("gpu avg");
+    ImGui::NextColumn();
+    ImGui::Text("gpu p95");
+    ImGui::NextColumn();
+    ImGui::Text("cpu avg");
+    ImGui::NextColumn();
+    ImGui::Text("cpu p95");
+    ImGui::NextColumn();
+    ImGui::Separator();
+
+    auto row = [](const PassStats& pass) {
+        ImGui::Text("%s", pass.name.c_str());
+        ImGui::NextColumn();
+        ImGui::Text("%.3f", average(pass.gpu_ms));
+        ImGui::NextColumn();
+        ImGui::Text("%.3f", percentile(pass.gpu_ms, 0.95f));
+        ImGui::NextColumn();
+        ImGui::Text("%.3f", average(pass.cpu_ms));
+        ImGui::NextColumn();
+        ImGui::Text("%.3f", percentile(pass.cpu_ms, 0.95f));
+        ImGui::NextColumn();
+    };
+    for (const PassStats& pass : passes) {
+        row(pass);
+    }
+    row(frame_stats);
+    ImGui::Columns(1);
+
+    for (const Counter& counter : counters) {
+        ImGui::Text("%s: %d (avg %.1f)", counter.name.c_str(), int(counter.last), double(counter.total) / counter.frames);
+    }
+
+    if (ImGui::Button("dump profile")) {
+        dump("pass_times.csv");
+    }
+}
+
+void Profiler::dump(const std::string& filename) const {
+    std::ofstream file(filename);
+    file << "pass,cpu_samples,cpu_avg_ms,cpu_p50_ms,cpu_p95_ms,cpu_p99_ms,gpu_samples,gpu_avg_ms,gpu_p50_ms,gpu_p95_ms,gpu_p99_ms\n";
+
+    auto line = [&](const PassStats& pass) {
+        file << pass.name << ','
+             << pass.cpu_ms.size() << ',' << average(pass.cpu_ms) << ',' << percentile(pass.cpu_ms, 0.5f) << ','
+             << percentile(pass.cpu_ms, 0.95f) << ',' << percentile(pass.cpu_ms, 0.99f) << ','
+             << pass.gpu_ms.size() << ',' << average(pass.gpu_ms) << ',' << percentile(pass.gpu_ms, 0.5f) << ','
+             << percentile(pass.gpu_ms, 0.95f) << ',' << percentile(pass.gpu_ms, 0.99f) << '\n';
+    };
+    for (const PassStats& pass : passes) {
+        line(pass);
+    }
+    line(frame_stats);
+
+    for (const Counter& counter : counters) {
+        std::cout << counter.name << ": avg " << double(counter.total) / counter.frames << " per frame\n";
+    }
+    std::cerr << "profile written to " << filename << std::endl;
+}
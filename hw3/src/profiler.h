@@ -0,0 +1,71 @@
+#pragma once
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include <GL/glew.h>
+
+// Per-pass CPU and GPU (GL_TIME_ELAPSED) timings with rolling statistics.
+// Passes can not be nested, GL allows only one active elapsed-time query.
+// Query results are read back FRAMES_IN_FLIGHT frames later and only if available, so it never stalls
+class Profiler {
+  public:
+    explicit Profiler(size_t history = 240);
+    ~Profiler();
+
+    void begin_frame();
+    void begin_pass(const char* name);
+    void end_pass();
+    // per frame count shown under the timings, e.g. issued and skipped uniform uploads
+    void counter(const char* name, size_t value);
+
+    void draw_imgui();
+    // csv with one line per pass: average and percentiles of cpu and gpu times in ms
+    void dump(const std::string& filename) const;
+
+  private:
+    static const size_t FRAMES_IN_FLIGHT = 3;
+    static const size_t MAX_PASSES = 16;
+
+    struct PassStats {
+        std::string name;
+        std::vector<float> cpu_ms;
+        std::vector<float> gpu_ms;
+        size_t cpu_next = 0;
+        size_t gpu_next = 0;
+    };
+
+    struct Counter {
+        std::string name;
+        size_t last = 0;
+        size_t total = 0;
+        size_t frames = 0;
+    };
+
+    struct FrameQueries {
+        GLuint queries[MAX_PASSES];
+        size_t pass_ids[MAX_PASSES];
+        size_t count = 0;
+    };
+
+    size_t find_pass(const char* name);
+    void collect(FrameQueries& frame);
+    void push(std::vector<float>& values, size_t& next, float value);
+
+    const size_t history;
+
+    std::vector<PassStats> passes;
+    std::vector<Counter> counters;
+    FrameQueries frames[FRAMES_IN_FLIGHT];
+    size_t frame_i = 0;
+    size_t dropped_frames = 0;
+
+    PassStats frame_stats;
+    bool frame_started = false;
+    std::chrono::steady_clock::time_point frame_start;
+
+    bool in_pass = false;
+    size_t current_pass;
+    std::chrono::steady_clock::time_point pass_start;
+};
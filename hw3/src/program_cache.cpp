@@ -0,0 +1,133 @@
+#include "program_cache.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+namespace {
+const char* CACHE_DIR = "shader_cache";
+const uint32_t CACHE_MAGIC = 0x31435053; // "SPC1"
+
+struct CacheHeader {
+    uint32_t magic;
+    uint32_t format;
+    uint32_t size;
+};
+
+// FNV-1a
+void hash_bytes(uint64_t& hash, const char* data, size_t size) {
+    for (size_t i = 0; i < size; i++) {
+        hash ^= (unsigned char)data[i];
+        hash *= 1099511628211ull;
+    }
+}
+
+void hash_string(uint64_t& hash, const std::string& s) {
+    // the length separates parts, "ab" + "c" and "a" + "bc" hash differently
+    uint64_t size = s.size();
+    hash_bytes(hash, (const char*)&size, sizeof(size));
+    hash_bytes(hash, s.data(), s.size());
+}
+
+std::string gl_string(GLenum name) {
+    const GLubyte* s = glGetString(name);
+    return s == NULL ? "" : (const char*)s;
+}
+
+std::string cache_filename(const std::string& key) {
+    return std::string(CACHE_DIR) + "/" + key + ".bin";
+}
+}
+
+bool program_binary_supported() {
+    static int supported = -1;
+    if (supported == -1) {
+        GLint formats = 0;
+        if (GLEW_VERSION_4_1 || GLEW_ARB_get_program_binary)
+            glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+        supported = formats > 0;
+        if (!supported)
+            std::cerr << "program binaries are not supported, shaders are compiled every start\n";
+    }
+    return supported;
+}
+
+std::string program_cache_key(const std::vector<std::string>& parts) {
+    uint64_t hash = 14695981039346656037ull;
+    hash_string(hash, gl_string(GL_VENDOR));
+    hash_string(hash, gl_string(GL_RENDERER));
+    hash_string(hash, gl_string(GL_VERSION));
+    for (const std::string& part : parts) {
+        hash_string(hash, part);
+    }
+
+    char key[17];
+    std::snprintf(key, sizeof(key), "%016llx", (unsigned long long)hash);
+    return key;
+}
+
+bool load_program_binary(GLuint program, const std::string& key) {
+    if (!program_binary_supported())
+        return false;
+
+    std::ifstream file(cache_filename(key), std::ios::binary);
+    if (!file)
+        return false;
+
+    CacheHeader header;
+    if (!file.read((char*)&header, sizeof(header)) || header.magic != CACHE_MAGIC)
+        return false;
+    std::vector<char> binary(header.size);
+    if (!file.read(binary.data(), binary.size()))
+        return false;
+
+    glProgramBinary(program, header.format, binary.data(), binary.size());
+    GLint success = 0;
+    glGetProgramiv(program, GL_LINK_STATUS, &success);
+    return success;
+}
+
+void save_program_binary(GLuint program, const std::string& key) {
+    if (!program_binary_supported())
+        return;
+
+    GLint size = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &size);
+    if (size <= 0)
+        return;
+
+    CacheHeader header;
+    header.magic = CACHE_MAGIC;
+    header.size = size;
+    std::vector<char> binary(size);
+    GLenum format;
+    glGetProgramBinary(program, size, NULL, &format, binary.data());
+    header.format = format;
+
+#ifdef _WIN32
+    _mkdir(CACHE_DIR);
+#else
+    mkdir(CACHE_DIR, 0755);
+#endif
+    // written under a temporary name so a crash never leaves a truncated entry
+    std::string filename = cache_filename(key);
+    std::string tmp_filename = filename + ".tmp";
+    {
+        std::ofstream file(tmp_filename, std::ios::binary);
+        file.write((const char*)&header, sizeof(header));
+        file.write(binary.data(), binary.size());
+        if (!file) {
+            std::cerr << "failed to write " << tmp_filename << std::endl;
+            return;
+        }
+    }
+    std::remove(filename.c_str());
+    std::rename(tmp_filename.c_str(), filename.c_str());
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <GL/glew.h>
+
+// On-disk cache of linked program binaries (glGetProgramBinary) in shader_cache/.
+// The key hashes the fully preprocessed sources together with the GL vendor, renderer and version
+// strings, so a driver update or an edited include invalidates the entry by itself
+std::string program_cache_key(const std::vector<std::string>& parts);
+
+// false if there is no entry or the driver rejects it, the program then has to be linked from source
+bool load_program_binary(GLuint program, const std::string& key);
+// program has to be linked with GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+void save_program_binary(GLuint program, const std::string& key);
+
+bool program_binary_supported();
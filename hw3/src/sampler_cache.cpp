@@ -0,0 +1,43 @@
+#include "sampler_cache.h"
+
+#include <algorithm>
+#include <map>
+#include <tuple>
+
+#include "gl_state.h"
+
+bool SamplerState::operator<(const SamplerState& other) const {
+    auto key = [](const SamplerState& s) { return std::tie(s.min_filter, s.mag_filter, s.wrap, s.compare_mode, s.compare_func); };
+    if (key(*this) != key(other))
+        return key(*this) < key(other);
+    return std::lexicographical_compare(border_color, border_color + 4, other.border_color, other.border_color + 4);
+}
+
+GLuint get_sampler(const SamplerState& state) {
+    // samplers live as long as the context, a handful of states is all the scenes use
+    static std::map<SamplerState, GLuint> samplers;
+    auto it = samplers.find(state);
+    if (it != samplers.end())
+        return it->second;
+
+    GLuint sampler;
+    glGenSamplers(1, &sampler);
+    glSamplerParameteri(sampler, GL_TEXTURE_MIN_FILTER, state.min_filter);
+    glSamplerParameteri(sampler, GL_TEXTURE_MAG_FILTER, state.mag_filter);
+    glSamplerParameteri(sampler, GL_TEXTURE_WRAP_S, state.wrap);
+    glSamplerParameteri(sampler, GL_TEXTURE_WRAP_T, state.wrap);
+    glSamplerParameteri(sampler, GL_TEXTURE_WRAP_R, state.wrap);
+    glSamplerParameteri(sampler, GL_TEXTURE_COMPARE_MODE, state.compare_mode);
+    glSamplerParameteri(sampler, GL_TEXTURE_COMPARE_FUNC, state.compare_func);
+    glSamplerParameterfv(sampler, GL_TEXTURE_BORDER_COLOR, state.border_color);
+    samplers.emplace(state, sampler);
+    return sampler;
+}
+
+void bind_sampler(GLuint unit, const SamplerState& state) {
+    gl_state::bind_sampler(unit, get_sampler(state));
+}
+
+void unbind_sampler(GLuint unit) {
+    gl_state::bind_sampler(unit, 0);
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <GL/glew.h>
+
+// Filtering, wrapping and depth compare state of a texture unit. Bound as a sampler object, so textures
+// need no glTexParameteri calls on every bind
+struct SamplerState {
+    GLenum min_filter;
+    GLenum mag_filter;
+    // S, T and R
+    GLenum wrap;
+    // GL_COMPARE_REF_TO_TEXTURE for depth textures sampled with sampler2DShadow
+    GLenum compare_mode;
+    GLenum compare_func;
+    // for GL_CLAMP_TO_BORDER
+    float border_color[4];
+
+    bool operator<(const SamplerState& other) const;
+};
+
+// the sampler object of state, created on first use and shared by every unit that uses the same state
+GLuint get_sampler(const SamplerState& state);
+
+void bind_sampler(GLuint unit, const SamplerState& state);
+// back to the parameters of the bound texture, e.g. for imgui
+void unbind_sampler(GLuint unit);
@@ -0,0 +1,97 @@
+#include "shader_preprocessor.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+namespace {
+bool read_file(const std::string& fname, std::string& content) {
+    std::ifstream file(fname.c_str());
+    if (!file) {
+        std::cerr << "Error reading shader file: " << fname << std::endl;
+        return false;
+    }
+    std::stringstream file_stream;
+    file_stream << file.rdbuf();
+    content = file_stream.str();
+    return true;
+}
+
+std::string directory_of(const std::string& fname) {
+    size_t slash = fname.find_last_of("/\\");
+    return slash == std::string::npos ? "" : fname.substr(0, slash + 1);
+}
+
+// `#include "name"` -> name, anything else -> ""
+std::string include_target(const std::string& line) {
+    size_t pos = line.find_first_not_of(" \t");
+    if (pos == std::string::npos || line.compare(pos, 8, "#include") != 0)
+        return "";
+    size_t open = line.find('"', pos + 8);
+    size_t close = open == std::string::npos ? open : line.find('"', open + 1);
+    if (close == std::string::npos)
+        return "";
+    return line.substr(open + 1, close - open - 1);
+}
+
+bool is_version(const std::string& line) {
+    size_t pos = line.find_first_not_of(" \t");
+    return pos != std::string::npos && line.compare(pos, 8, "#version") == 0;
+}
+
+void expand(const std::string& fname, const std::vector<std::string>& defines, ShaderSource& source, std::ostringstream& out) {
+    std::string content;
+    if (!read_file(fname, content))
+        return;
+
+    const int file_i = source.files.size();
+    source.files.push_back(fname);
+    if (file_i != 0)
+        out << "#line 1 " << file_i << '\n';
+
+    std::istringstream lines(content);
+    std::string line;
+    int line_i = 0;
+    while (std::getline(lines, line)) {
+        line_i++;
+
+        if (file_i == 0 && is_version(line)) {
+            out << line << '\n';
+            for (const std::string& define : defines) {
+                out << "#define " << define << '\n';
+            }
+            out << "#line " << line_i + 1 << ' ' << file_i << '\n';
+            continue;
+        }
+
+        std::string target = include_target(line);
+        if (target.empty()) {
+            out << line << '\n';
+            continue;
+        }
+
+        std::string include_fname = directory_of(fname) + target;
+        if (std::find(source.files.begin(), source.files.end(), include_fname) == source.files.end()) {
+            expand(include_fname, defines, source, out);
+        }
+        out << "#line " << line_i + 1 << ' ' << file_i << '\n';
+    }
+}
+}
+
+ShaderSource preprocess_shader(const std::string& fname, const std::vector<std::string>& defines) {
+    ShaderSource source;
+    std::ostringstream out;
+    expand(fname, defines, source, out);
+    source.code = out.str();
+    return source;
+}
+
+std::string source_legend(const ShaderSource& source) {
+    std::ostringstream legend;
+    for (size_t i = 0; i < source.files.size(); i++) {
+        legend << i << ": " << source.files[i] << '\n';
+    }
+    return legend.str();
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+// One stage after preprocessing. files[i] is source string number i of the #line directives,
+// files[0] is the stage file itself, the rest are its includes
+struct ShaderSource {
+    std::string code;
+    std::vector<std::string> files;
+};
+
+// Expands `#include "file"` (relative to the including file, every file is included once per stage,
+// so includes need no guards), puts `#define`s right after #version and adds #line directives so
+// driver errors point at the right file and line. A define is "NAME" or "NAME VALUE"
+ShaderSource preprocess_shader(const std::string& fname, const std::vector<std::string>& defines);
+
+// "0: assets/object.fs\n1: assets/light.fs\n..." to decode the file numbers in a driver log
+std::string source_legend(const ShaderSource& source);
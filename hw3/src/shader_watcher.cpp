@@ -0,0 +1,122 @@
+#include "shader_watcher.h"
+
+#include <algorithm>
+#include <iostream>
+
+#ifdef __linux__
+#include <cerrno>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+namespace {
+std::string directory_of(const std::string& fname) {
+    size_t slash = fname.find_last_of("/\\");
+    return slash == std::string::npos ? "" : fname.substr(0, slash + 1);
+}
+}
+
+ShaderWatcher::ShaderWatcher() {
+#ifdef __linux__
+    inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotify_fd == -1)
+        std::cerr << "inotify is not available, shaders will not be reloaded\n";
+#else
+    std::cerr << "shader reloading needs inotify, shaders will not be reloaded\n";
+#endif
+}
+
+ShaderWatcher::~ShaderWatcher() {
+#ifdef __linux__
+    if (inotify_fd != -1)
+        close(inotify_fd);
+#endif
+}
+
+void ShaderWatcher::watch(shader_t& shader) {
+    shaders.push_back(&shader);
+    watch_files(shader);
+}
+
+void ShaderWatcher::watch(ShaderPermutations& permutations) {
+    this->permutations.emplace_back(&permutations, permutations.variant_count());
+    permutations.for_each_variant([this](shader_t& shader) { watch_files(shader); });
+}
+
+void ShaderWatcher::watch_files(const shader_t& shader) {
+#ifdef __linux__
+    if (inotify_fd == -1)
+        return;
+    for (const std::string& file : shader.dependencies()) {
+        std::string directory = directory_of(file);
+        // inotify returns the same descriptor for a directory that is already watched
+        int wd = inotify_add_watch(inotify_fd, directory.empty() ? "." : directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+        if (wd == -1) {
+            std::cerr << "can not watch " << file << std::endl;
+            continue;
+        }
+        directories[wd] = directory;
+    }
+#endif
+}
+
+std::set<std::string> ShaderWatcher::changed_files() {
+    std::set<std::string> changed;
+#ifdef __linux__
+    if (inotify_fd == -1)
+        return changed;
+
+    alignas(inotify_event) char buffer[4096];
+    while (true) {
+        ssize_t length = read(inotify_fd, buffer, sizeof(buffer));
+        if (length <= 0)
+            break;
+        for (char* ptr = buffer; ptr < buffer + length;) {
+            const inotify_event* event = (const inotify_event*)ptr;
+            auto it = directories.find(event->wd);
+            if (it != directories.end() && event->len > 0)
+                changed.insert(it->second + event->name);
+            ptr += sizeof(inotify_event) + event->len;
+        }
+    }
+#endif
+    return changed;
+}
+
+int ShaderWatcher::reload_if_changed(shader_t& shader, const std::set<std::string>& changed) {
+    const std::vector<std::string>& files = shader.dependencies();
+    auto it = std::find_if(files.begin(), files.end(), [&](const std::string& file) { return changed.count(file) != 0; });
+    if (it == files.end())
+        return 0;
+
+    std::cerr << "reloading " << files.front() << " (" << *it << " changed)" << std::endl;
+    bool linked = shader.reload();
+    // the files may have a new #include
+    watch_files(shader);
+    if (!linked)
+        std::cerr << "reload failed, keeping the previous program" << std::endl;
+    return linked;
+}
+
+int ShaderWatcher::poll() {
+    for (auto& watched : permutations) {
+        if (watched.first->variant_count() != watched.second) {
+            watched.second = watched.first->variant_count();
+            watched.first->for_each_variant([this](shader_t& shader) { watch_files(shader); });
+        }
+    }
+
+    // an editor save may produce several events, they are all handled by one reload
+    std::set<std::string> changed = changed_files();
+    if (changed.empty())
+        return 0;
+
+    int reloaded = 0;
+    for (shader_t* shader : shaders) {
+        reloaded += reload_if_changed(*shader, changed);
+    }
+    for (auto& watched : permutations) {
+        watched.first->for_each_variant([&](shader_t& shader) { reloaded += reload_if_changed(shader, changed); });
+    }
+    return reloaded;
+}
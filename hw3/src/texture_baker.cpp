@@ -0,0 +1,57 @@
+// Offline image -> texture_cache converter:
+//   texture-baker [--flip] [--mips] [--linear] <image> [<out.tex>]
+//   texture-baker --cube <+x> <-x> <+y> <-y> <+z> <-z> [<out.tex>]
+// The app bakes material textures with --flip --mips, masks with --flip --mips --linear and the skybox with --cube. Without an output name the
+// file goes where the app looks for it, so run it from build/
+#include <cstring>
+#include <iostream>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb_image.h>
+
+#include "texture_cache.h"
+
+int main(int argc, char **argv) {
+    uint32_t flags = 0;
+    int arg = 1;
+    for (; arg < argc && std::strncmp(argv[arg], "--", 2) == 0; arg++) {
+        if (std::strcmp(argv[arg], "--flip") == 0) {
+            flags |= TEXTURE_FLIPPED;
+        } else if (std::strcmp(argv[arg], "--mips") == 0) {
+            flags |= TEXTURE_MIPMAPPED;
+        } else if (std::strcmp(argv[arg], "--linear") == 0) {
+            flags |= TEXTURE_LINEAR;
+        } else if (std::strcmp(argv[arg], "--cube") == 0) {
+            flags |= TEXTURE_CUBEMAP;
+        } else {
+            std::cerr << "unknown option " << argv[arg] << std::endl;
+            return 1;
+        }
+    }
+    std::vector<std::string> sources(argv + arg, argv + argc);
+    size_t face_count = (flags & TEXTURE_CUBEMAP) ? 6 : 1;
+    if (sources.size() != face_count && sources.size() != face_count + 1) {
+        std::cerr << "usage: " << argv[0] << " [--flip] [--mips] [--linear] <image> [<out.tex>]" << std::endl;
+        std::cerr << "       " << argv[0] << " --cube <+x> <-x> <+y> <-y> <+z> <-z> [<out.tex>]" << std::endl;
+        return 1;
+    }
+    std::string texture_filename = texture_cache_filename(sources[0], flags);
+    if (sources.size() > face_count) {
+        texture_filename = sources.back();
+        sources.pop_back();
+    }
+    if (!bake_texture(sources, flags, texture_filename)) {
+        std::cerr << "failed baking " << sources[0] << std::endl;
+        return 1;
+    }
+
+    TextureFile file;
+    if (!file.open(texture_filename)) {
+        std::cerr << "failed reading back " << texture_filename << std::endl;
+        return 1;
+    }
+    const TextureFileHeader& header = file.header();
+    std::cout << texture_filename << ": " << header.width << " * " << header.height << ", " << header.face_count << " faces, "
+              << header.level_count << " levels" << std::endl;
+    return 0;
+}
@@ -0,0 +1,212 @@
+#include "texture_cache.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+
+#include <stb_image.h>
+
+#include "mipmap.h"
+#include "parallel.h"
+
+namespace {
+const char* CACHE_DIR = "texture_cache";
+
+size_t align16(size_t offset) {
+    return (offset + 15) & ~size_t(15);
+}
+
+// one source image with its mip levels
+struct BakedImage {
+    std::shared_ptr<unsigned char> pixels;
+    int width = 0;
+    int height = 0;
+    std::vector<MipLevel> mipmaps;
+};
+}
+
+unsigned char* decode_image(const char* filename, int& width, int& height, bool flip_vertically) {
+    int channels = 0;
+    unsigned char* image = stbi_load(filename, &width, &height, &channels, STBI_rgb);
+    if (image == nullptr) {
+        std::cerr << "failed to load " << filename << ": " << stbi_failure_reason() << std::endl;
+        return nullptr;
+    }
+    if (flip_vertically) {
+        size_t row = 3 * size_t(width);
+        std::vector<unsigned char> tmp(row);
+        for (int y = 0; y < height / 2; y++) {
+            unsigned char* top = image + row * y;
+            unsigned char* bottom = image + row * (height - 1 - y);
+            std::memcpy(tmp.data(), top, row);
+            std::memcpy(top, bottom, row);
+            std::memcpy(bottom, tmp.data(), row);
+        }
+    }
+    return image;
+}
+
+std::string texture_cache_filename(const std::string& source, uint32_t flags) {
+    std::string name = source;
+    std::replace(name.begin(), name.end(), '/', '_');
+    std::replace(name.begin(), name.end(), '\\', '_');
+    if (flags & TEXTURE_FLIPPED)
+        name += ".flip";
+    if (flags & TEXTURE_CUBEMAP)
+        name += ".cube";
+    if (flags & TEXTURE_MIPMAPPED)
+        name += ".mips";
+    if (flags & TEXTURE_LINEAR)
+        name += ".linear";
+    return std::string(CACHE_DIR) + "/" + name + ".tex";
+}
+
+bool bake_texture(const std::vector<std::string>& sources, uint32_t flags, const std::string& texture_filename) {
+    const size_t face_count = (flags & TEXTURE_CUBEMAP) ? 6 : 1;
+    if (sources.empty() || sources.size() % face_count != 0) {
+        std::cerr << "expected a multiple of " << face_count << " images for " << texture_filename << std::endl;
+        return false;
+    }
+
+    std::vector<BakedImage> images(sources.size());
+    parallel_for(sources.size(), [&](size_t i) {
+        BakedImage& image = images[i];
+        image.pixels.reset(decode_image(sources[i].c_str(), image.width, image.height, flags & TEXTURE_FLIPPED), stbi_image_free);
+        if (image.pixels && (flags & TEXTURE_MIPMAPPED))
+            image.mipmaps = generate_mipmaps(image.pixels.get(), image.width, image.height, !(flags & TEXTURE_LINEAR));
+    });
+    for (size_t i = 0; i < images.size(); i++) {
+        if (!images[i].pixels)
+            return false;
+        if (images[i].width != images[0].width || images[i].height != images[0].height) {
+            std::cerr << "images differ in size: " << sources[i] << std::endl;
+            return false;
+        }
+    }
+
+    TextureFileHeader header = {};
+    header.magic = TEXTURE_FILE_MAGIC;
+    header.version = TEXTURE_FILE_VERSION;
+    for (const std::string& source : sources) {
+        uint64_t size = 0;
+        int64_t mtime = 0;
+        source_stat(source, size, mtime);
+        header.source_size += size;
+        header.source_mtime = std::max(header.source_mtime, mtime);
+    }
+    header.format = TEXTURE_FORMAT_RGB8;
+    header.flags = flags;
+    header.width = images[0].width;
+    header.height = images[0].height;
+    header.level_count = 1 + images[0].mipmaps.size();
+    header.face_count = face_count;
+    header.layer_count = sources.size() / face_count;
+
+    // images are ordered like the level table, layer by layer and face by face
+    std::vector<TextureFileLevel> levels;
+    std::vector<const unsigned char*> level_pixels;
+    size_t offset = align16(sizeof(header) + sizeof(TextureFileLevel) * images.size() * header.level_count);
+    for (const BakedImage& image : images) {
+        for (size_t i = 0; i < header.level_count; i++) {
+            TextureFileLevel level = {};
+            level.width = i == 0 ? image.width : image.mipmaps[i - 1].width;
+            level.height = i == 0 ? image.height : image.mipmaps[i - 1].height;
+            level.offset = offset;
+            level.size = 3 * size_t(level.width) * level.height;
+            offset = align16(offset + level.size);
+            levels.push_back(level);
+            level_pixels.push_back(i == 0 ? image.pixels.get() : image.mipmaps[i - 1].pixels.data());
+        }
+    }
+
+    make_cache_directory(CACHE_DIR);
+    // written under a temporary name so a crash never leaves a truncated file
+    std::string tmp_filename = texture_filename + ".tmp";
+    {
+        std::ofstream file(tmp_filename, std::ios::binary);
+        file.write((const char*)&header, sizeof(header));
+        file.write((const char*)levels.data(), sizeof(TextureFileLevel) * levels.size());
+        for (size_t i = 0; i < levels.size(); i++) {
+            file.seekp(levels[i].offset);
+            file.write((const char*)level_pixels[i], levels[i].size);
+        }
+        if (!file) {
+            std::cerr << "failed to write " << tmp_filename << std::endl;
+            return false;
+        }
+    }
+    std::remove(texture_filename.c_str());
+    return std::rename(tmp_filename.c_str(), texture_filename.c_str()) == 0;
+}
+
+bool TextureFile::open(const std::string& texture_filename, const std::vector<std::string>& sources) {
+    if (!file.open(texture_filename))
+        return false;
+    data = file.data();
+    if (!valid()) {
+        close();
+        return false;
+    }
+    uint64_t source_size = 0;
+    int64_t source_mtime = 0;
+    for (const std::string& source : sources) {
+        uint64_t size;
+        int64_t mtime;
+        if (!source_stat(source, size, mtime))
+            return true;
+        source_size += size;
+        source_mtime = std::max(source_mtime, mtime);
+    }
+    if (!sources.empty() && (source_size != header().source_size || source_mtime != header().source_mtime)) {
+        close();
+        return false;
+    }
+    return true;
+}
+
+void TextureFile::close() {
+    file.close();
+    data = nullptr;
+}
+
+const TextureFileLevel& TextureFile::level(size_t layer, size_t face, size_t level) const {
+    const TextureFileLevel* table = (const TextureFileLevel*)(data + sizeof(TextureFileHeader));
+    return table[(layer * header().face_count + face) * header().level_count + level];
+}
+
+const unsigned char* TextureFile::pixels(size_t layer, size_t face, size_t level) const {
+    return data + this->level(layer, face, level).offset;
+}
+
+bool TextureFile::valid() const {
+    const size_t size = file.size();
+    if (size < sizeof(TextureFileHeader) || header().magic != TEXTURE_FILE_MAGIC || header().version != TEXTURE_FILE_VERSION)
+        return false;
+    if (header().format != TEXTURE_FORMAT_RGB8 || header().level_count == 0 || header().level_count > 32
+        || header().face_count != ((header().flags & TEXTURE_CUBEMAP) ? 6u : 1u) || header().layer_count == 0)
+        return false;
+    size_t level_count = size_t(header().layer_count) * header().face_count * header().level_count;
+    if (sizeof(TextureFileHeader) + sizeof(TextureFileLevel) * level_count > size)
+        return false;
+    const TextureFileLevel* table = (const TextureFileLevel*)(data + sizeof(TextureFileHeader));
+    for (size_t i = 0; i < level_count; i++) {
+        if (table[i].size != 3 * uint64_t(table[i].width) * table[i].height || table[i].offset > size || table[i].size > size - table[i].offset)
+            return false;
+    }
+    return true;
+}
+
+bool open_baked_texture(TextureFile& file, const std::vector<std::string>& sources, uint32_t flags) {
+    std::string texture_filename = texture_cache_filename(sources[0], flags);
+    if (file.open(texture_filename, sources))
+        return true;
+    std::cout << "baking " << sources[0] << " into " << texture_filename << std::endl;
+    if (!bake_texture(sources, flags, texture_filename) || !file.open(texture_filename)) {
+        std::cerr << "failed loading " << sources[0] << std::endl;
+        return false;
+    }
+    return true;
+}
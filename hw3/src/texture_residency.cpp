@@ -0,0 +1,97 @@
+#include "texture_residency.h"
+
+#include <vector>
+
+#include "gl_state.h"
+
+std::string canonical_path(const std::string& path) {
+    std::vector<std::string> parts;
+    bool absolute = !path.empty() && (path[0] == '/' || path[0] == '\\');
+    size_t begin = 0;
+    while (begin <= path.size()) {
+        size_t end = path.find_first_of("/\\", begin);
+        if (end == std::string::npos)
+            end = path.size();
+        std::string part = path.substr(begin, end - begin);
+        if (part == "..") {
+            // leading ones of a relative path stay
+            if (!parts.empty() && parts.back() != "..")
+                parts.pop_back();
+            else if (!absolute)
+                parts.push_back(part);
+        } else if (!part.empty() && part != ".") {
+            parts.push_back(part);
+        }
+        begin = end + 1;
+    }
+
+    std::string result = absolute ? "/" : "";
+    for (size_t i = 0; i < parts.size(); i++) {
+        result += (i == 0 ? "" : "/") + parts[i];
+    }
+    return result;
+}
+
+TextureResidency::TextureResidency(size_t budget_bytes)
+    : state(std::make_shared<State>())
+    , budget_bytes(budget_bytes) {
+}
+
+TextureRef TextureResidency::acquire(const Key& key, bool& created) {
+    auto it = state->entries.find(key);
+    created = it == state->entries.end();
+    if (created) {
+        it = state->entries.emplace(key, Entry()).first;
+        glGenTextures(1, &it->second.texture);
+    } else if (TextureRef ref = it->second.ref.lock()) {
+        return ref;
+    } else {
+        state->released.erase(it->second.released_position);
+    }
+    return make_ref(key, it->second);
+}
+
+void TextureResidency::loaded(const Key& key, size_t bytes) {
+    auto it = state->entries.find(key);
+    if (it == state->entries.end())
+        return;
+    state->bytes += bytes - it->second.bytes;
+    it->second.bytes = bytes;
+    it->second.loading = false;
+}
+
+void TextureResidency::evict() {
+    auto it = state->released.begin();
+    while (state->bytes > budget_bytes && it != state->released.end()) {
+        Entry& entry = state->entries.at(*it);
+        if (entry.loading) {
+            it++;
+            continue;
+        }
+        gl_state::forget_texture(entry.texture);
+        glDeleteTextures(1, &entry.texture);
+        state->bytes -= entry.bytes;
+        state->entries.erase(*it);
+        it = state->released.erase(it);
+    }
+}
+
+void TextureResidency::set_budget(size_t budget_bytes) {
+    this->budget_bytes = budget_bytes;
+}
+
+TextureRef TextureResidency::make_ref(const Key& key, Entry& entry) {
+    std::weak_ptr<State> weak_state = state;
+    TextureRef ref(new GLuint(entry.texture), [weak_state, key](const GLuint* texture) {
+        delete texture;
+        // no GL calls, the context may already be gone; evict() deletes it
+        std::shared_ptr<State> state = weak_state.lock();
+        if (!state)
+            return;
+        auto it = state->entries.find(key);
+        if (it != state->entries.end())
+            it->second.released_position = state->released.insert(state->released.end(), key);
+    });
+    entry.ref = ref;
+    return ref;
+}
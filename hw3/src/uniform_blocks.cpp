@@ -0,0 +1,16 @@
+#include "uniform_blocks.h"
+
+namespace {
+const UniformBlockInfo blocks[] = {
+    { "Camera", 0, sizeof(CameraBlock) },
+    { "Lights", 1, sizeof(LightsBlock) },
+};
+}
+
+const UniformBlockInfo* find_uniform_block(const std::string& name) {
+    for (const UniformBlockInfo& block : blocks) {
+        if (name == block.name)
+            return &block;
+    }
+    return NULL;
+}
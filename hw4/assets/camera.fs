@@ -0,0 +1,7 @@
+
+// keep in sync with CameraBlock in uniform_blocks.h
+layout (std140) uniform Camera {
+    mat4 u_vp;
+    vec3 u_cam;
+    vec3 u_cam_forward;
+};
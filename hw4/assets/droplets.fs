@@ -1,6 +1,6 @@
 #version 330 core
 
-#myinclude_light
+#include "light.fs"
 
 out vec4 o_frag_color;
 
@@ -9,25 +9,9 @@ in vec2 texcoord;
 
 uniform sampler2D u_droplet_tex;
 
-uniform sampler2D u_shadow_tex;
-uniform mat4 u_shadow_view;
-
-int get_shadow(vec3 obj_pos) {
-    vec4 scoord = u_shadow_view * vec4(obj_pos, 1);
-    scoord /= scoord.w;
-    scoord = scoord / 2 + 0.5;
-    float shadow_depth = texture(u_shadow_tex, scoord.xy).x;
-
-    if (scoord.z - 1e-3 >= shadow_depth)
-        return 0;
-    else
-        return 1;
-}
-
 void main() {
-    int shadow = get_shadow(position);
-
-    o_frag_color = sky_grey * (0.7 + 0.5 * get_shadow(position));
+    // the sun's cascades, dl_depth and dl_vp of light.fs
+    o_frag_color = sky_grey * (0.7 + 0.5 * get_shadow_dl(position, 0));
 
     float alpha = 1 - texture(u_droplet_tex, texcoord).x;
     
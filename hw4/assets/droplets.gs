@@ -6,26 +6,24 @@ layout (triangle_strip, max_vertices = 6) out;
 out vec3 position;
 out vec2 texcoord;
 
-uniform vec3 camera_position;
-uniform vec3 camera_forward;
-uniform mat4 u_mvp;
+#include "camera.fs"
 
 uniform float width;
 uniform float height;
 
-uniform mat4 u_height_view;
+// HeightField: (min, max) height of the static geometry, uv = (xz - u_height_area.xy) * u_height_area.z
 uniform sampler2D u_height_tex;
+uniform vec3 u_height_area;
 
 float get_shadow(vec3 obj_pos) {
-    vec4 scoord = u_height_view * vec4(obj_pos, 1);
-    scoord /= scoord.w;
-    scoord = scoord / 2 + 0.5;
-    float shadow_depth = texture(u_height_tex, scoord.xy).x;
+    vec2 uv = (obj_pos.xz - u_height_area.xy) * u_height_area.z;
+    float top = textureLod(u_height_tex, uv, 0).y;
 
-    if (scoord.z - 1e-3 >= shadow_depth)
-        return 0;
+    // drops just under a surface still show, like the 1e-3 depth bias did
+    if (obj_pos.y < top - 0.1)
+        return 0.0;
     else
-        return 1;
+        return 1.0;
 }
 
 void main()
@@ -52,8 +50,8 @@ void main()
     }
 
     vec3 camera_up = vec3(0, 1, 0);
-    vec3 camera_fw_plane = camera_forward - camera_up * dot(camera_forward, camera_up);
-    vec3 camera_left = cross(camera_forward, camera_up);
+    vec3 camera_fw_plane = u_cam_forward - camera_up * dot(u_cam_forward, camera_up);
+    vec3 camera_left = cross(u_cam_forward, camera_up);
 
     vec3 up = camera_up * height;
     vec3 left = camera_left * (width / 2);
@@ -65,7 +63,7 @@ void main()
         for (int v = 0; v < 3; v++) {
             int i = tr * 3 + v;
             position = point_pos + left * left_mult[i] + up * (up_mult[i] + 1) / 2;
-            gl_Position = u_mvp * vec4(position, 1.0);
+            gl_Position = u_vp * vec4(position, 1.0);
             texcoord = (vec2(1 - left_mult[i], 1 + up_mult[i])) / 2;
             EmitVertex();
         }
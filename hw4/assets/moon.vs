@@ -15,7 +15,6 @@ struct vx_output_t
 out vx_output_t v_out;
 
 uniform mat4 u_mvp;
-uniform vec3 u_cam;
 uniform mat4 u_m;
 
 uniform vec2 u_tile;
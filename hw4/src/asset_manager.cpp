@@ -0,0 +1,254 @@
+#include "asset_manager.h"
+
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <memory>
+
+#include "gl_state.h"
+#include "mesh_cache.h"
+#include "texture_cache.h"
+
+namespace {
+const unsigned char PLACEHOLDER_TEXEL[3] = { 128, 128, 128 };
+// a failed load keeps its placeholder, 4 bytes a face like upload_pixels estimates
+const size_t PLACEHOLDER_BYTES = 4;
+// until set_budget, enough for every texture of the scenes
+const size_t DEFAULT_TEXTURE_BUDGET = size_t(256) << 20;
+}
+
+AssetManager::AssetManager(size_t thread_count)
+    : residency(DEFAULT_TEXTURE_BUDGET) {
+    if (thread_count == 0)
+        thread_count = std::max(2u, std::thread::hardware_concurrency()) - 1;
+    for (size_t i = 0; i < thread_count; i++) {
+        workers.emplace_back(&AssetManager::worker, this);
+    }
+}
+
+AssetManager::~AssetManager() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    job_added.notify_all();
+    for (std::thread& thread : workers) {
+        thread.join();
+    }
+    // no GL calls here, the context may already be gone
+}
+
+TextureRef AssetManager::texture(const std::string& filename, bool flip_vertically, bool linear) {
+    uint32_t flags = TEXTURE_MIPMAPPED | (flip_vertically ? TEXTURE_FLIPPED : 0) | (linear ? TEXTURE_LINEAR : 0);
+    TextureResidency::Key key(canonical_path(filename), flags);
+    bool created;
+    TextureRef ref = residency.acquire(key, created);
+    if (!created)
+        return ref;
+
+    GLuint texture = *ref;
+    gl_state::bind_texture(0, GL_TEXTURE_2D, texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, 1, 1, 0, GL_RGB, GL_UNSIGNED_BYTE, PLACEHOLDER_TEXEL);
+
+    enqueue([this, texture, key]() -> Upload {
+        // decoded and mip mapped once into texture_cache/, later starts map the levels and copy them as they are
+        auto file = std::make_shared<TextureFile>();
+        if (!open_baked_texture(*file, { key.first }, key.second))
+            return [this, key]() { residency.loaded(key, PLACEHOLDER_BYTES); };
+        return [this, texture, key, file]() {
+            const std::string& filename = key.first;
+            std::cout << "Loading " << filename << ' ' << file->header().width << ' ' << file->header().height << std::endl;
+            std::vector<PixelUpload> levels;
+            for (size_t i = 0; i < file->header().level_count; i++) {
+                const TextureFileLevel& level = file->level(0, 0, i);
+                levels.push_back({ GL_TEXTURE_2D, GLint(i), int(level.width), int(level.height), file->pixels(0, 0, i) });
+            }
+            gl_state::bind_texture(0, GL_TEXTURE_2D, texture);
+            residency.loaded(key, upload_pixels(levels));
+        };
+    });
+    return ref;
+}
+
+TextureRef AssetManager::cubemap(const std::vector<std::string>& filenames) {
+    std::string faces;
+    for (const std::string& filename : filenames) {
+        faces += canonical_path(filename) + "\n";
+    }
+    TextureResidency::Key key(faces, TEXTURE_CUBEMAP);
+    bool created;
+    TextureRef ref = residency.acquire(key, created);
+    if (!created)
+        return ref;
+
+    GLuint texture = *ref;
+    gl_state::bind_texture(0, GL_TEXTURE_CUBE_MAP, texture);
+    for (int i = 0; i < 6; i++) {
+        glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB8, 1, 1, 0, GL_RGB, GL_UNSIGNED_BYTE, PLACEHOLDER_TEXEL);
+    }
+
+    enqueue([this, texture, key, filenames]() -> Upload {
+        auto file = std::make_shared<TextureFile>();
+        if (!open_baked_texture(*file, filenames, TEXTURE_CUBEMAP))
+            return [this, key]() { residency.loaded(key, 6 * PLACEHOLDER_BYTES); };
+        return [this, texture, key, file]() {
+            std::cout << "loaded " << file->header().width << " * " << file->header().height << " cubemap faces" << std::endl;
+            std::vector<PixelUpload> images;
+            for (int i = 0; i < 6; i++) {
+                images.push_back({ GLenum(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i), 0, int(file->header().width), int(file->header().height), file->pixels(0, i, 0) });
+            }
+            gl_state::bind_texture(0, GL_TEXTURE_CUBE_MAP, texture);
+            residency.loaded(key, upload_pixels(images));
+        };
+    });
+    return ref;
+}
+
+std::vector<Mesh>& AssetManager::object(const std::string& path, const std::string& filename) {
+    objects.emplace_back();
+    std::vector<Mesh>& meshes = objects.back();
+
+    enqueue([this, &meshes, path, filename]() -> Upload {
+        // the OBJ is parsed once into mesh_cache/, later starts read the mapped file
+        std::string mesh_filename = mesh_cache_filename(filename);
+        MeshFile file;
+        if (!file.open(mesh_filename, filename)) {
+            std::cout << "baking " << filename << " into " << mesh_filename << std::endl;
+            if (!bake_mesh(filename, mesh_filename) || !file.open(mesh_filename)) {
+                std::cerr << "failed loading " << filename << std::endl;
+                return Upload();
+            }
+        }
+
+        std::vector<MeshFileMaterial> materials;
+        for (size_t i = 0; i < file.header().material_count; i++) {
+            materials.push_back(file.material(i));
+        }
+        std::vector<uint32_t> mesh_materials;
+        auto packed = std::make_shared<std::vector<PackedMesh>>();
+        for (size_t i = 0; i < file.header().mesh_count; i++) {
+            const MeshFileEntry& entry = file.mesh(i);
+            mesh_materials.push_back(entry.material);
+            // 16 instead of 32 bytes a vertex, texcoords outside [0, 1] stay float
+            packed->push_back(pack_mesh(file.vertices(i), entry.vertex_count * MESH_VERTEX_FLOATS, file.indices(i), entry.index_count, { 3, 3, 2 },
+                                        { AttribFormat::HALF, AttribFormat::NORMAL_10_10_10, AttribFormat::UNORM16 }));
+        }
+
+        return [this, &meshes, path, materials, mesh_materials, packed]() {
+            std::vector<Material> mats;
+            for (const MeshFileMaterial& material : materials) {
+                if (material.texture[0] != '\0') {
+                    mats.emplace_back(texture(path + material.texture));
+                } else {
+                    float diffuse[3] = { material.diffuse[0], material.diffuse[1], material.diffuse[2] };
+                    mats.emplace_back(diffuse);
+                }
+            }
+            float white[3] = { 1, 1, 1 };
+            meshes.reserve(packed->size());
+            for (size_t i = 0; i < packed->size(); i++) {
+                Material material = mesh_materials[i] == NO_MATERIAL ? Material(white) : mats[mesh_materials[i]];
+                meshes.emplace_back((*packed)[i], std::vector<Material> { material });
+            }
+        };
+    });
+    return meshes;
+}
+
+void AssetManager::update(double budget_ms) {
+    auto start = std::chrono::steady_clock::now();
+    while (run_upload(false)) {
+        if (std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() >= budget_ms)
+            break;
+    }
+    residency.evict();
+}
+
+void AssetManager::finish() {
+    // uploads may request more, e.g. an object its textures
+    while (pending_ > 0) {
+        run_upload(true);
+    }
+}
+
+size_t AssetManager::pending() const {
+    return pending_;
+}
+
+void AssetManager::enqueue(Job job) {
+    pending_++;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        jobs.push_back(std::move(job));
+    }
+    job_added.notify_one();
+}
+
+void AssetManager::worker() {
+    while (true) {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            job_added.wait(lock, [this]() { return stopping || !jobs.empty(); });
+            if (stopping)
+                return;
+            job = std::move(jobs.front());
+            jobs.pop_front();
+        }
+        Upload upload = job();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            uploads.push_back(std::move(upload));
+        }
+        upload_added.notify_one();
+    }
+}
+
+bool AssetManager::run_upload(bool wait) {
+    Upload upload;
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (wait)
+            upload_added.wait(lock, [this]() { return !uploads.empty(); });
+        if (uploads.empty())
+            return false;
+        upload = std::move(uploads.front());
+        uploads.pop_front();
+    }
+    // failed object loads have no upload, textures report their placeholder
+    if (upload)
+        upload();
+    pending_--;
+    return true;
+}
+
+size_t AssetManager::upload_pixels(const std::vector<PixelUpload>& images) {
+    std::vector<size_t> offsets;
+    size_t total_size = 0;
+    for (const PixelUpload& image : images) {
+        offsets.push_back(total_size);
+        total_size += 3 * size_t(image.width) * image.height;
+    }
+    if (upload_buffer == 0)
+        glGenBuffers(1, &upload_buffer);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, upload_buffer);
+    glBufferData(GL_PIXEL_UNPACK_BUFFER, total_size, nullptr, GL_STREAM_DRAW);
+    unsigned char* mapped = (unsigned char*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, total_size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    if (mapped != nullptr) {
+        for (size_t i = 0; i < images.size(); i++) {
+            std::memcpy(mapped + offsets[i], images[i].pixels, 3 * size_t(images[i].width) * images[i].height);
+        }
+        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+        // RGB rows are not 4 byte aligned for every width
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        for (size_t i = 0; i < images.size(); i++) {
+            const PixelUpload& image = images[i];
+            glTexImage2D(image.target, image.level, GL_RGB8, image.width, image.height, 0, GL_RGB, GL_UNSIGNED_BYTE, (const void*)offsets[i]);
+        }
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    // drivers keep RGB8 in 4 bytes a texel
+    return total_size / 3 * 4;
+}
@@ -1,5 +1,7 @@
 #include "droplet.h"
 
+#include "gl_state.h"
+
 std::mt19937 Droplets::rng(533);
 
 Droplets::Droplets(size_t n, float tile_size, float height, float speed, float drop_width, float drop_height)
@@ -24,7 +26,7 @@ Droplets::Droplets(size_t n, float tile_size, float height, float speed, float d
     // init vertex array
     glGenVertexArrays(1, &vao);
     glGenBuffers(1, &vbo);
-    glBindVertexArray(vao);
+    gl_state::bind_vertex_array(vao);
     glBindBuffer(GL_ARRAY_BUFFER, vbo);
     glBufferData(GL_ARRAY_BUFFER, sizeof(float) * 3 * n, &positions[0], GL_STATIC_DRAW);
 
@@ -32,7 +34,7 @@ Droplets::Droplets(size_t n, float tile_size, float height, float speed, float d
     glEnableVertexAttribArray(0);
 
     glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindVertexArray(0);
+    gl_state::bind_vertex_array(0);
 }
 
 void Droplets::draw(shader_t &shader, float time) {
@@ -55,9 +57,8 @@ void Droplets::draw(shader_t &shader, float time) {
     shader.set_uniform("width", drop_width);
     shader.set_uniform("height", drop_height);
 
-    glBindVertexArray(vao);
+    gl_state::bind_vertex_array(vao);
     glDrawArrays(GL_POINTS, 0, n);
-    glBindVertexArray(0);
 }
 
 void Droplets::generate_flatcoord(size_t id) {
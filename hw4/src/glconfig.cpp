@@ -1,5 +1,9 @@
 #include "glconfig.h"
 
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
 #include <iostream>
 #include <numeric>
 
@@ -11,7 +15,196 @@
 #include "../bindings/imgui_impl_glfw.h"
 #include "../bindings/imgui_impl_opengl3.h"
 
-#include "tiny_obj_loader.h"
+#include "gl_state.h"
+#include "sampler_cache.h"
+
+namespace {
+const SamplerState MATERIAL_SAMPLER = { GL_LINEAR_MIPMAP_LINEAR, GL_LINEAR, GL_MIRRORED_REPEAT, GL_NONE, GL_LEQUAL, { 0, 0, 0, 0 } };
+// hardware depth compare, lit where the reference is not behind the map, filtered over 2x2 texels.
+// Outside the light's view reads as lit
+const SamplerState SHADOW_SAMPLER = { GL_LINEAR, GL_LINEAR, GL_CLAMP_TO_BORDER, GL_COMPARE_REF_TO_TEXTURE, GL_LEQUAL, { 1, 1, 1, 1 } };
+// glPolygonOffset of the casters instead of a fixed bias in the shaders. The slope part is 4 texels of the
+// caster's depth slope, as far as the widest PCF kernel reaches
+const float SHADOW_SLOPE_BIAS = 4.0f;
+const float SHADOW_CONSTANT_BIAS = 4.0f;
+// CascadedShadow splits, 0 is even and 1 logarithmic in the view distance
+const float CASCADE_LOG_SPLIT = 0.75f;
+
+// IEEE 754 binary16, rounded to nearest. Callers check the range, larger values become infinity
+uint16_t to_half(float value) {
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    uint32_t sign = (bits >> 16) & 0x8000;
+    int exponent = int((bits >> 23) & 0xff) - 127 + 15;
+    uint32_t mantissa = bits & 0x7fffff;
+
+    if (exponent <= 0) {
+        // subnormal half or zero
+        if (exponent < -10)
+            return sign;
+        mantissa |= 0x800000;
+        int shift = 14 - exponent;
+        uint32_t half_mantissa = mantissa >> shift;
+        if ((mantissa >> (shift - 1)) & 1)
+            half_mantissa++;
+        return sign | half_mantissa;
+    }
+    if (exponent >= 31)
+        return sign | 0x7c00;
+    // a carry out of the mantissa correctly increments the exponent
+    uint32_t half = sign | (exponent << 10) | (mantissa >> 13);
+    if (mantissa & 0x1000)
+        half++;
+    return half;
+}
+
+size_t attrib_bytes(AttribFormat format, size_t components) {
+    switch (format) {
+    case AttribFormat::HALF:
+        return (2 * components + 3) & ~size_t(3);
+    case AttribFormat::NORMAL_10_10_10:
+        return 4;
+    case AttribFormat::UNORM16:
+        return (2 * components + 3) & ~size_t(3);
+    default:
+        return 4 * components;
+    }
+}
+
+// whether every value of one attribute can be stored in format
+bool format_fits(AttribFormat format, const float* first, size_t components, size_t vertex_floats, size_t vertex_num) {
+    if (format == AttribFormat::NORMAL_10_10_10 && components != 3)
+        return false;
+    for (size_t v = 0; v < vertex_num; v++) {
+        for (size_t c = 0; c < components; c++) {
+            float value = first[v * vertex_floats + c];
+            if (format == AttribFormat::HALF && !(std::abs(value) <= 65504.0f))
+                return false;
+            if (format == AttribFormat::UNORM16 && !(value >= 0.0f && value <= 1.0f))
+                return false;
+        }
+    }
+    return true;
+}
+
+void pack_attrib(AttribFormat format, const float* values, size_t components, unsigned char* out) {
+    switch (format) {
+    case AttribFormat::FLOAT:
+        std::memcpy(out, values, sizeof(float) * components);
+        break;
+    case AttribFormat::HALF:
+        for (size_t c = 0; c < components; c++) {
+            uint16_t half = to_half(values[c]);
+            std::memcpy(out + 2 * c, &half, sizeof(half));
+        }
+        break;
+    case AttribFormat::NORMAL_10_10_10: {
+        float length = std::sqrt(values[0] * values[0] + values[1] * values[1] + values[2] * values[2]);
+        uint32_t packed = 0;
+        for (int c = 0; c < 3; c++) {
+            float value = length > 0 ? values[c] / length : 0;
+            int32_t snorm = int32_t(std::round(std::max(-1.0f, std::min(1.0f, value)) * 511));
+            packed |= (uint32_t(snorm) & 0x3ff) << (10 * c);
+        }
+        std::memcpy(out, &packed, sizeof(packed));
+        break;
+    }
+    case AttribFormat::UNORM16:
+        for (size_t c = 0; c < components; c++) {
+            uint16_t unorm = uint16_t(std::round(values[c] * 65535));
+            std::memcpy(out + 2 * c, &unorm, sizeof(unorm));
+        }
+        break;
+    }
+}
+
+struct MaterialUniforms {
+    uniform_handle<int> tex;
+    uniform_handle<float> texture_a;
+    uniform_handle<float> prism_n;
+    uniform_handle<glm::vec3> color;
+};
+
+// resolved once per shader and material index instead of building "u_tex" + i every draw
+const MaterialUniforms &material_uniforms(shader_t &shader, size_t i) {
+    static std::vector<std::pair<const shader_t *, std::vector<MaterialUniforms>>> cache;
+
+    auto it = std::find_if(cache.begin(), cache.end(), [&](const auto &entry) { return entry.first == &shader; });
+    if (it == cache.end()) {
+        cache.emplace_back(&shader, std::vector<MaterialUniforms>());
+        it = cache.end() - 1;
+    }
+
+    std::vector<MaterialUniforms> &uniforms = it->second;
+    while (uniforms.size() <= i) {
+        const std::string i_str = std::to_string(uniforms.size());
+        uniforms.push_back({ shader.get_handle<int>("u_tex" + i_str),
+                             shader.get_handle<float>("u_texture_a" + i_str),
+                             shader.get_handle<float>("u_prism_n" + i_str),
+                             shader.get_handle<glm::vec3>("u_color" + i_str) });
+    }
+    return uniforms[i];
+}
+// largest change of a matrix element that keeps a cached shadow map, well below a texel of the maps here
+const float SHADOW_CACHE_EPSILON = 1e-6f;
+
+float max_difference(const glm::mat4& a, const glm::mat4& b) {
+    float difference = 0;
+    for (int i = 0; i < 4; i++) {
+        for (int j = 0; j < 4; j++) {
+            difference = std::max(difference, std::abs(a[i][j] - b[i][j]));
+        }
+    }
+    return difference;
+}
+
+// depth texture with SHADOW_SAMPLER's parameters and a framebuffer for every layer, GL_TEXTURE_2D has one
+void create_shadow_target(GLenum target, size_t width, size_t height, size_t layers, GLuint& texture, GLuint* framebuffers) {
+    glGenTextures(1, &texture);
+    gl_state::bind_texture(0, target, texture);
+    if (target == GL_TEXTURE_2D_ARRAY)
+        glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT24, width, height, layers, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+    else
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT, width, height, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+    // set once here for readers without a sampler, bind_shadow_texture() binds SHADOW_SAMPLER
+    glTexParameteri(target, GL_TEXTURE_MIN_FILTER, SHADOW_SAMPLER.min_filter);
+    glTexParameteri(target, GL_TEXTURE_MAG_FILTER, SHADOW_SAMPLER.mag_filter);
+    glTexParameteri(target, GL_TEXTURE_WRAP_S, SHADOW_SAMPLER.wrap);
+    glTexParameteri(target, GL_TEXTURE_WRAP_T, SHADOW_SAMPLER.wrap);
+    glTexParameterfv(target, GL_TEXTURE_BORDER_COLOR, SHADOW_SAMPLER.border_color);
+    glTexParameteri(target, GL_TEXTURE_COMPARE_MODE, SHADOW_SAMPLER.compare_mode);
+    glTexParameteri(target, GL_TEXTURE_COMPARE_FUNC, SHADOW_SAMPLER.compare_func);
+
+    glGenFramebuffers(layers, framebuffers);
+    for (size_t i = 0; i < layers; i++) {
+        gl_state::bind_framebuffer(framebuffers[i]);
+        if (target == GL_TEXTURE_2D_ARRAY)
+            glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, texture, 0, i);
+        else
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, texture, 0);
+        glDrawBuffer(GL_NONE);
+        glReadBuffer(GL_NONE);
+    }
+    gl_state::bind_framebuffer(0);
+}
+
+// state for drawing casters into the bound shadow target, unset_shadow() turns the offset off again
+void begin_casters() {
+    gl_state::set_enabled(GL_DEPTH_TEST, true);
+    gl_state::set_enabled(GL_POLYGON_OFFSET_FILL, true);
+    glPolygonOffset(SHADOW_SLOPE_BIAS, SHADOW_CONSTANT_BIAS);
+}
+
+// depth of from into to, which is left bound for casters, so casters drawn next keep the nearer depth.
+// gl_state tracks draw and read as one binding, so read is set back
+void copy_depth(GLuint from, GLuint to, size_t width, size_t height) {
+    gl_state::bind_framebuffer(to);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, from);
+    glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, to);
+    begin_casters();
+}
+}
 
 static void glfw_error_callback(int error, const char *description) {
     std::cerr << fmt::format("Glfw Error {}: {}\n", error, description);
@@ -68,35 +261,21 @@ void setup_imgui(GLFWwindow *window) {
 }
 
 void load_image(GLuint &texture, const char* filename, bool flip_vertically) {
-    int width = 0, height = 0, channels = 0;
-    stbi_set_flip_vertically_on_load(flip_vertically);
-    unsigned char *image = stbi_load(
-        filename,
-        //  "assets/test.png",
-        &width,
-        &height,
-        &channels,
-        STBI_rgb);
-
-    std::cout << "Loading " << filename << ' ' << width << ' ' << height << ' ' << channels << std::endl;
-
     glGenTextures(1, &texture);
-    glBindTexture(GL_TEXTURE_2D, texture);
-    // if (channels == 4) {
-    //     glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, image);
-    // }
-    // else {
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, image);
-    // }
+    gl_state::bind_texture(0, GL_TEXTURE_2D, texture);
+    TextureFile file;
+    if (!open_baked_texture(file, { filename }, flip_vertically ? TEXTURE_FLIPPED : 0))
+        return;
+    const TextureFileLevel& level = file.level(0, 0, 0);
+    std::cout << "Loading " << filename << ' ' << level.width << ' ' << level.height << std::endl;
+
+    // RGB rows are not 4 byte aligned for every width
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, level.width, level.height, 0, GL_RGB, GL_UNSIGNED_BYTE, file.pixels(0, 0, 0));
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
     glGenerateMipmap(GL_TEXTURE_2D);
-
-    stbi_image_free(image);
 }
 
-Material::Material(std::string texture_filename, GLfloat texture_a, GLfloat prism_n) : texture_a(texture_a), prism_n(prism_n) {
-    glGenTextures(1, &texture);
-    load_image(texture, texture_filename.c_str());
-}
 Material::Material(float color[], GLfloat texture_a, GLfloat prism_n)
     : texture_a(texture_a)
     , prism_n(prism_n) {
@@ -105,6 +284,13 @@ Material::Material(float color[], GLfloat texture_a, GLfloat prism_n)
     color_[2] = color[2];
     texture = -1;
 }
+Material::Material(TextureRef texture, GLfloat texture_a, GLfloat prism_n)
+    : texture_a(texture_a)
+    , prism_n(prism_n)
+    , texture(*texture)
+    , texture_ref(texture) {
+    color_[0] = color_[1] = color_[2] = 1;
+}
 
 GLuint Material::get_texture() const {
     return texture;
@@ -114,28 +300,101 @@ glm::vec3 Material::get_color() const {
     return glm::vec3(color_[0], color_[1], color_[2]);
 }
 
-Mesh::Mesh(std::vector<float> vertices, std::vector<unsigned int> indices, std::vector<Material> materials, std::vector<size_t> attribs)
+Mesh::Mesh(std::vector<float> vertices, std::vector<unsigned int> indices, std::vector<Material> materials, std::vector<size_t> attribs, std::vector<AttribFormat> formats)
+    : Mesh(&vertices[0], vertices.size(), &indices[0], indices.size(), materials, attribs, formats) {
+}
+
+PackedMesh pack_mesh(const float* vertices, size_t vertex_floats, const unsigned int* indices, size_t index_count, std::vector<size_t> attribs, std::vector<AttribFormat> formats) {
+    PackedMesh packed;
+    const size_t all_attr_len = std::accumulate(attribs.begin(), attribs.end(), size_t(0));
+    const size_t vertex_num = vertex_floats / all_attr_len;
+
+    // byte layout of one vertex, every attribute starts 4 byte aligned
+    formats.resize(attribs.size(), AttribFormat::FLOAT);
+    std::vector<size_t> float_offsets;
+    size_t float_offset = 0, stride = 0;
+    bool all_float = true;
+    for (size_t attr_i = 0; attr_i < attribs.size(); attr_i++) {
+        if (!format_fits(formats[attr_i], vertices + float_offset, attribs[attr_i], all_attr_len, vertex_num))
+            formats[attr_i] = AttribFormat::FLOAT;
+        all_float = all_float && formats[attr_i] == AttribFormat::FLOAT;
+        float_offsets.push_back(float_offset);
+        packed.byte_offsets.push_back(stride);
+        float_offset += attribs[attr_i];
+        stride += attrib_bytes(formats[attr_i], attribs[attr_i]);
+    }
+    packed.stride = stride;
+    packed.attribs = attribs;
+    packed.formats = formats;
+
+    if (all_float) {
+        packed.vertices.assign((const unsigned char*)vertices, (const unsigned char*)(vertices + vertex_floats));
+    } else {
+        packed.vertices.resize(stride * vertex_num);
+        for (size_t v = 0; v < vertex_num; v++) {
+            for (size_t attr_i = 0; attr_i < attribs.size(); attr_i++) {
+                pack_attrib(formats[attr_i], vertices + v * all_attr_len + float_offsets[attr_i], attribs[attr_i], &packed.vertices[v * stride + packed.byte_offsets[attr_i]]);
+            }
+        }
+    }
+
+    packed.index_count = index_count;
+    if (vertex_num <= 0x10000) {
+        packed.index_type = GL_UNSIGNED_SHORT;
+        packed.indices.resize(sizeof(uint16_t) * index_count);
+        for (size_t i = 0; i < index_count; i++) {
+            uint16_t index = indices[i];
+            std::memcpy(&packed.indices[sizeof(uint16_t) * i], &index, sizeof(index));
+        }
+    } else {
+        packed.index_type = GL_UNSIGNED_INT;
+        packed.indices.assign((const unsigned char*)indices, (const unsigned char*)(indices + index_count));
+    }
+    return packed;
+}
+
+Mesh::Mesh(const float* vertices, size_t vertex_floats, const unsigned int* indices, size_t index_count, std::vector<Material> materials, std::vector<size_t> attribs, std::vector<AttribFormat> formats)
+    : Mesh(pack_mesh(vertices, vertex_floats, indices, index_count, attribs, formats), materials) {
+}
+
+Mesh::Mesh(const PackedMesh& packed, std::vector<Material> materials)
     : mats(materials) {
-    vertex_count = vertices.size();
+    vertex_count = packed.index_count;
+    index_type = packed.index_type;
 
     glGenVertexArrays(1, &vao);
     glGenBuffers(1, &vbo);
     glGenBuffers(1, &ebo);
-    glBindVertexArray(vao);
+    gl_state::bind_vertex_array(vao);
     glBindBuffer(GL_ARRAY_BUFFER, vbo);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(float) * vertices.size(), &vertices[0], GL_STATIC_DRAW);
+    glBufferData(GL_ARRAY_BUFFER, packed.vertices.size(), packed.vertices.data(), GL_STATIC_DRAW);
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(unsigned int) * indices.size(), &indices[0], GL_STATIC_DRAW);
-
-    size_t all_attr_len = std::accumulate(attribs.begin(), attribs.end(), 0);
-    size_t prev_attr_len = 0;
-    for (size_t attr_i = 0; attr_i < attribs.size(); attr_i++) {
-        glVertexAttribPointer(attr_i, attribs[attr_i], GL_FLOAT, GL_FALSE, all_attr_len * sizeof(float), (void *)(prev_attr_len * sizeof(float)));
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, packed.indices.size(), packed.indices.data(), GL_STATIC_DRAW);
+
+    const size_t stride = packed.stride;
+    for (size_t attr_i = 0; attr_i < packed.attribs.size(); attr_i++) {
+        const void* offset = (void *)packed.byte_offsets[attr_i];
+        const size_t components = packed.attribs[attr_i];
+        switch (packed.formats[attr_i]) {
+        case AttribFormat::FLOAT:
+            glVertexAttribPointer(attr_i, components, GL_FLOAT, GL_FALSE, stride, offset);
+            break;
+        case AttribFormat::HALF:
+            glVertexAttribPointer(attr_i, components, GL_HALF_FLOAT, GL_FALSE, stride, offset);
+            break;
+        case AttribFormat::NORMAL_10_10_10:
+            // packed types always have 4 components, w is 0
+            glVertexAttribPointer(attr_i, 4, GL_INT_2_10_10_10_REV, GL_TRUE, stride, offset);
+            break;
+        case AttribFormat::UNORM16:
+            glVertexAttribPointer(attr_i, components, GL_UNSIGNED_SHORT, GL_TRUE, stride, offset);
+            break;
+        }
         glEnableVertexAttribArray(attr_i);
-        prev_attr_len += attribs[attr_i];
     }
     glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindVertexArray(0);
+    // unbound so later GL_ELEMENT_ARRAY_BUFFER binds can not change it
+    gl_state::bind_vertex_array(0);
 }
 
 Mesh::Mesh(GLuint vbo, GLuint vao, GLuint ebo, std::vector<Material> materials, int vertex_count)
@@ -149,30 +408,22 @@ void Mesh::draw(shader_t &shader) {
     for (int i = 0; i < mats.size(); i++) {
         const Material &mat = mats[i];
 
-        glActiveTexture(GL_TEXTURE1 + i);
-        glBindTexture(GL_TEXTURE_2D, mat.get_texture());
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_MIRRORED_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_MIRRORED_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_R, GL_MIRRORED_REPEAT);
-
-        const std::string i_str = std::to_string(i);
-        shader.set_uniform<int>("u_tex" + i_str, i + 1);
-        shader.set_uniform<float>("u_texture_a" + i_str, mat.texture_a);
-        shader.set_uniform<float>("u_prism_n" + i_str, mat.prism_n);
+        gl_state::bind_texture(1 + i, GL_TEXTURE_2D, mat.get_texture());
+        bind_sampler(1 + i, MATERIAL_SAMPLER);
 
-        shader.set_uniform<float>("u_color" + i_str, mat.get_color().x, mat.get_color().y, mat.get_color().z);
+        const MaterialUniforms &uniforms = material_uniforms(shader, i);
+        shader.set_uniform(uniforms.tex, i + 1);
+        shader.set_uniform(uniforms.texture_a, mat.texture_a);
+        shader.set_uniform(uniforms.prism_n, mat.prism_n);
+        shader.set_uniform(uniforms.color, mat.get_color());
     }
     draw();
 }
 
 void Mesh::draw() {
-    // Bind vertex array = buffers + indices
-    glBindVertexArray(vao);
-    // Execute draw call
-    glDrawElements(GL_TRIANGLES, vertex_count, GL_UNSIGNED_INT, 0);
-    glBindVertexArray(0);
+    // left bound, the next draw of this mesh skips the bind
+    gl_state::bind_vertex_array(vao);
+    glDrawElements(GL_TRIANGLES, vertex_count, index_type, 0);
 }
 
 glm::vec3 to_tor(glm::vec3 pos, float R, float r) {
@@ -215,36 +466,59 @@ Mesh genTriangulation(unsigned int width, unsigned int heigth) {
     return Mesh(vertices, indices, std::vector<Material>(), { 2 });
 }
 
-Shadow::Shadow(size_t width, size_t height)
+bool ShadowCache::update(const glm::mat4& light_view, const std::vector<ShadowCaster>& casters) {
+    bool changed = !valid || casters.size() != this->casters.size() || max_difference(light_view, this->light_view) > SHADOW_CACHE_EPSILON;
+    for (size_t i = 0; i < casters.size() && !changed; i++) {
+        changed = casters[i].mesh_count != this->casters[i].mesh_count || max_difference(casters[i].model, this->casters[i].model) > SHADOW_CACHE_EPSILON;
+    }
+    if (!changed)
+        return false;
+    valid = true;
+    this->light_view = light_view;
+    this->casters = casters;
+    return true;
+}
+
+Shadow::Shadow(size_t width, size_t height, bool dynamic_layer)
     : width(width)
     , height(height) {
 
-    glGenFramebuffers(1, &depth_buffer);
+    create_shadow_target(GL_TEXTURE_2D, width, height, 1, shadow_map, &depth_buffer);
+    if (dynamic_layer)
+        create_shadow_target(GL_TEXTURE_2D, width, height, 1, static_map, &static_buffer);
+}
 
-    glGenTextures(1, &shadow_map);
-    glBindTexture(GL_TEXTURE_2D, shadow_map);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT, width, height, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+void Shadow::set_shadow(glm::mat4 light_view) {
+    view = light_view;
+    // the map is overwritten, a later set_static_shadow() draws again
+    cache.invalidate();
 
-    glBindFramebuffer(GL_FRAMEBUFFER, depth_buffer);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, shadow_map, 0);
-    glDrawBuffer(GL_NONE);
-    glReadBuffer(GL_NONE);
-    
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    gl_state::viewport(0, 0, width, height);
+    gl_state::bind_framebuffer(depth_buffer);
+    begin_casters();
+    glClear(GL_DEPTH_BUFFER_BIT);
 }
 
-void Shadow::set_shadow(glm::mat4 light_view) {
+bool Shadow::set_static_shadow(glm::mat4 light_view, const std::vector<ShadowCaster>& casters) {
+    if (!cache.update(light_view, casters))
+        return false;
     view = light_view;
 
-    glViewport(0, 0, width, height);
-    glBindFramebuffer(GL_FRAMEBUFFER, depth_buffer);
+    gl_state::viewport(0, 0, width, height);
+    gl_state::bind_framebuffer(static_buffer != 0 ? static_buffer : depth_buffer);
+    begin_casters();
     glClear(GL_DEPTH_BUFFER_BIT);
+    return true;
+}
+
+void Shadow::set_dynamic_shadow() {
+    gl_state::viewport(0, 0, width, height);
+    copy_depth(static_buffer, depth_buffer, width, height);
 }
 
 void Shadow::unset_shadow() {
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    gl_state::bind_framebuffer(0);
+    gl_state::set_enabled(GL_POLYGON_OFFSET_FILL, false);
 }
 
 GLuint Shadow::get_shadow_map() {
@@ -252,12 +526,106 @@ GLuint Shadow::get_shadow_map() {
 }
 
 void Shadow::bind_shadow_texture(unsigned int slot) {
-    glActiveTexture(GL_TEXTURE0 + slot);
-    glBindTexture(GL_TEXTURE_2D, shadow_map);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
-    float border[] = { 1, 1, 1, 1 };
-    glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, border);
-}
\ No newline at end of file
+    gl_state::bind_texture(slot, GL_TEXTURE_2D, shadow_map);
+    bind_sampler(slot, SHADOW_SAMPLER);
+}
+
+CascadedShadow::CascadedShadow(size_t size, size_t cascade_count, bool dynamic_layer)
+    : views(cascade_count)
+    , splits(cascade_count)
+    , size(size)
+    , framebuffers(cascade_count)
+    , fitted(cascade_count)
+    , caches(cascade_count) {
+
+    create_shadow_target(GL_TEXTURE_2D_ARRAY, size, size, cascade_count, shadow_map, framebuffers.data());
+    if (dynamic_layer) {
+        static_framebuffers.resize(cascade_count);
+        create_shadow_target(GL_TEXTURE_2D_ARRAY, size, size, cascade_count, static_map, static_framebuffers.data());
+    }
+}
+
+void CascadedShadow::fit(const glm::mat4& camera_view, float fovy, float aspect, float near, float far, glm::vec3 light_dir,
+                         glm::vec3 scene_center, float scene_radius) {
+    // the splits only depend on near and far, a cascade keeps its size while the camera moves
+    glm::mat4 camera_to_world = glm::inverse(camera_view);
+    float tan_y = std::tan(fovy / 2);
+    float tan_x = tan_y * aspect;
+
+    glm::vec3 dir = glm::normalize(light_dir);
+    glm::vec3 up = std::abs(dir.y) > 0.99f ? glm::vec3(1, 0, 0) : glm::vec3(0, 1, 0);
+    // x and y along the map, looking away from the light
+    glm::mat4 light_rotation = glm::lookAt(glm::vec3(0), -dir, up);
+
+    float slice_near = near;
+    for (size_t i = 0; i < views.size(); i++) {
+        float t = float(i + 1) / views.size();
+        float slice_far = CASCADE_LOG_SPLIT * near * std::pow(far / near, t) + (1 - CASCADE_LOG_SPLIT) * (near + (far - near) * t);
+        splits[i] = slice_far;
+
+        glm::vec3 corners[8];
+        glm::vec3 center(0);
+        for (int c = 0; c < 8; c++) {
+            float z = (c & 4) ? slice_far : slice_near;
+            corners[c] = glm::vec3(camera_to_world * glm::vec4(((c & 1) ? 1 : -1) * tan_x * z, ((c & 2) ? 1 : -1) * tan_y * z, -z, 1));
+            center += corners[c] / 8.0f;
+        }
+        float radius = 0;
+        for (const glm::vec3& corner : corners) {
+            radius = std::max(radius, glm::length(corner - center));
+        }
+        // rounded up, float noise in the corners must not change the texel size
+        radius = std::ceil(radius * 16) / 16;
+
+        float texel = 2 * radius / size;
+        glm::vec3 light_center = glm::vec3(light_rotation * glm::vec4(center, 1));
+        light_center.x = std::floor(light_center.x / texel) * texel;
+        light_center.y = std::floor(light_center.y / texel) * texel;
+        // the depth range moves in steps of radius too, so a still box keeps the same matrix: the slice is
+        // at most radius behind the moved center, casters are up to caster_distance before the real one
+        float center_offset = light_center.z - std::floor(light_center.z / radius) * radius;
+        light_center.z -= center_offset;
+        float caster_distance = glm::length(center - scene_center) + scene_radius + center_offset;
+        caster_distance = std::ceil(caster_distance / radius) * radius;
+        fitted[i] = glm::ortho(-radius, radius, -radius, radius, -caster_distance, radius) * glm::translate(-light_center) * light_rotation;
+
+        slice_near = slice_far;
+    }
+}
+
+void CascadedShadow::set_cascade(size_t i) {
+    views[i] = fitted[i];
+    caches[i].invalidate();
+
+    gl_state::viewport(0, 0, size, size);
+    gl_state::bind_framebuffer(framebuffers[i]);
+    begin_casters();
+    glClear(GL_DEPTH_BUFFER_BIT);
+}
+
+bool CascadedShadow::set_static_cascade(size_t i, const std::vector<ShadowCaster>& casters) {
+    if (!caches[i].update(fitted[i], casters))
+        return false;
+    views[i] = fitted[i];
+
+    gl_state::viewport(0, 0, size, size);
+    gl_state::bind_framebuffer(static_map != 0 ? static_framebuffers[i] : framebuffers[i]);
+    begin_casters();
+    glClear(GL_DEPTH_BUFFER_BIT);
+    return true;
+}
+
+void CascadedShadow::set_dynamic_cascade(size_t i) {
+    gl_state::viewport(0, 0, size, size);
+    copy_depth(static_framebuffers[i], framebuffers[i], size, size);
+}
+
+void CascadedShadow::unset_shadow() {
+    gl_state::bind_framebuffer(0);
+    gl_state::set_enabled(GL_POLYGON_OFFSET_FILL, false);
+}
+
+void CascadedShadow::bind_shadow_texture(unsigned int slot) {
+    gl_state::bind_texture(slot, GL_TEXTURE_2D_ARRAY, shadow_map);
+    bind_sampler(slot, SHADOW_SAMPLER);
+}
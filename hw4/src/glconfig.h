@@ -1,5 +1,6 @@
 #pragma once
 
+#include <memory>
 
 #include <GL/glew.h>
 
@@ -22,16 +23,14 @@
 #include <glm/gtx/transform.hpp>
 
 
-// obj loader
-// #define TINYOBJLOADER_IMPLEMENTATION
-#include "tiny_obj_loader.h"
-
 #include "opengl_shader.h"
+#include "texture_cache.h"
 
 GLFWwindow* init_window();
 
 void setup_imgui(GLFWwindow* window);
 
+// level 0 through texture_cache/, the driver builds the mip levels
 void load_image(GLuint& texture, const char* filename, bool flip_vertically = true);
 
 template <typename T>
@@ -44,10 +43,13 @@ void crop_abs(T& x, T max_abs) {
     crop_interval(x, -max_abs, max_abs);
 }
 
+// shared ownership of a texture from the AssetManager, which may delete it once no ref is left
+typedef std::shared_ptr<const GLuint> TextureRef;
+
 class Material {
   public:
-    Material(std::string texture_filename, GLfloat texture_a = 1, GLfloat prism_n = 0);
     Material(float color[], GLfloat texture_a = 1, GLfloat prism_n = 0);
+    Material(TextureRef texture, GLfloat texture_a = 1, GLfloat prism_n = 0);
 
     GLuint get_texture() const;
     glm::vec3 get_color() const;
@@ -56,12 +58,44 @@ class Material {
     const GLfloat prism_n;
   private:
     GLuint texture;
+    // keeps texture alive, copies of the material share it
+    TextureRef texture_ref;
     float color_[3];
 };
 
+// How a vertex attribute is stored in the buffer, shaders read every format as floats.
+// Data a format can not hold (out of range) is stored as FLOAT instead
+enum class AttribFormat {
+    FLOAT,
+    // GL_HALF_FLOAT, padded to 4 byte alignment
+    HALF,
+    // GL_INT_2_10_10_10_REV normalized, for 3 component unit vectors
+    NORMAL_10_10_10,
+    // GL_UNSIGNED_SHORT normalized, values in [0, 1]
+    UNORM16,
+};
+
+// Vertex and index bytes in the layout the buffers get, built without GL so loader threads can prepare them
+struct PackedMesh {
+    std::vector<unsigned char> vertices;
+    std::vector<unsigned char> indices;
+    size_t index_count;
+    GLenum index_type;
+    size_t stride;
+    std::vector<size_t> attribs;
+    std::vector<AttribFormat> formats;
+    std::vector<size_t> byte_offsets;
+};
+
+// formats[i] is the storage of attribs[i], missing ones are FLOAT. Indices are 16 bit when every index fits
+PackedMesh pack_mesh(const float* vertices, size_t vertex_floats, const unsigned int* indices, size_t index_count, std::vector<size_t> attribs, std::vector<AttribFormat> formats = {});
+
 class Mesh {
   public:
-    Mesh(std::vector<float> vertices, std::vector<unsigned int> indices, std::vector<Material> materials, std::vector<size_t> attribs);
+    Mesh(std::vector<float> vertices, std::vector<unsigned int> indices, std::vector<Material> materials, std::vector<size_t> attribs, std::vector<AttribFormat> formats = {});
+    Mesh(const float* vertices, size_t vertex_floats, const unsigned int* indices, size_t index_count, std::vector<Material> materials, std::vector<size_t> attribs, std::vector<AttribFormat> formats = {});
+    // only the upload, the packing was done before
+    Mesh(const PackedMesh& packed, std::vector<Material> materials);
     Mesh(GLuint vbo, GLuint vao, GLuint ebo, std::vector<Material> materials, int vertex_count);
 
     void draw();
@@ -72,15 +106,44 @@ class Mesh {
     GLuint vbo, vao, ebo;
 
     int vertex_count;
+    GLenum index_type = GL_UNSIGNED_INT;
 };
 
 Mesh genTriangulation(unsigned int width, unsigned int heigth);
 
+// An object drawn into a shadow map. The mesh count changes while the asset manager appends meshes
+struct ShadowCaster {
+    glm::mat4 model;
+    size_t mesh_count;
+};
+
+// What a cached shadow map was last drawn with. The map is out of date once the light view or the model
+// of a caster changed by more than SHADOW_CACHE_EPSILON in any element, or meshes were added
+class ShadowCache {
+  public:
+    // true if out of date, light_view and casters are then remembered as drawn
+    bool update(const glm::mat4& light_view, const std::vector<ShadowCaster>& casters);
+    void invalidate() { valid = false; }
+
+  private:
+    bool valid = false;
+    glm::mat4 light_view;
+    std::vector<ShadowCaster> casters;
+};
+
 class Shadow {
   public:
-    Shadow(size_t width, size_t height);
+    // a dynamic layer keeps the static casters in a second texture, see set_dynamic_shadow()
+    Shadow(size_t width, size_t height, bool dynamic_layer = false);
 
+    // drawn every time, e.g. for a moving light
     void set_shadow(glm::mat4 light_view);
+    // true if the static casters have to be drawn again with view, the map is then bound and cleared.
+    // Otherwise nothing is bound and view stays what the map was drawn with
+    bool set_static_shadow(glm::mat4 light_view, const std::vector<ShadowCaster>& casters);
+    // dynamic layer only, after set_static_shadow(): binds the map holding a copy of the static casters,
+    // moving casters drawn with view after it keep the nearer depth
+    void set_dynamic_shadow();
     void unset_shadow();
 
     void bind_shadow_texture(unsigned int slot);
@@ -94,4 +157,51 @@ class Shadow {
 
     GLuint shadow_map;
     GLuint depth_buffer;
-};
\ No newline at end of file
+    // dynamic layer, 0 without
+    GLuint static_map = 0;
+    GLuint static_buffer = 0;
+    ShadowCache cache;
+};
+
+// Directional light shadow split along the camera view into cascades, layers of one depth texture array.
+// Every cascade is an ortho box around a bounding sphere of its slice of the view frustum, so near receivers
+// get most of the texels. The boxes move in whole texels and keep their size when the camera turns, so the
+// shadow edges do not shimmer, and a cascade whose box did not move keeps its cached map
+class CascadedShadow {
+  public:
+    // a dynamic layer keeps the static casters in a second texture array, see set_dynamic_cascade()
+    CascadedShadow(size_t size, size_t cascade_count, bool dynamic_layer = false);
+
+    // fovy in radians. Slices are split between near and far, mixing even and logarithmic splits; casters
+    // between a slice and the light are inside the scene sphere. Takes effect as the cascades are set
+    void fit(const glm::mat4& camera_view, float fovy, float aspect, float near, float far, glm::vec3 light_dir,
+             glm::vec3 scene_center, float scene_radius);
+
+    // render target of cascade i, draw the casters with views[i]. Drawn every time
+    void set_cascade(size_t i);
+    // like Shadow::set_static_shadow(), true if the static casters have to be drawn again with views[i]
+    bool set_static_cascade(size_t i, const std::vector<ShadowCaster>& casters);
+    // dynamic layer only, like Shadow::set_dynamic_shadow()
+    void set_dynamic_cascade(size_t i);
+    void unset_shadow();
+
+    // GL_TEXTURE_2D_ARRAY, one layer a cascade
+    void bind_shadow_texture(unsigned int slot);
+
+    // light view projection every cascade was drawn with, near to far
+    std::vector<glm::mat4> views;
+    // camera distance where every cascade ends
+    std::vector<float> splits;
+
+  private:
+    const size_t size;
+
+    GLuint shadow_map;
+    std::vector<GLuint> framebuffers;
+    // dynamic layer, empty without
+    GLuint static_map = 0;
+    std::vector<GLuint> static_framebuffers;
+    // from the last fit(), views of the cascades drawn since
+    std::vector<glm::mat4> fitted;
+    std::vector<ShadowCache> caches;
+};
@@ -0,0 +1,188 @@
+#include "headless.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <numeric>
+
+#ifdef HEADLESS_EGL
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
+HeadlessOptions parse_headless_options(int argc, char** argv) {
+    HeadlessOptions options;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--headless") {
+            options.enabled = true;
+        } else if (arg == "--frames" && i + 1 < argc) {
+            options.frames = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--csv" && i + 1 < argc) {
+            options.csv_filename = argv[++i];
+        } else if (arg == "--size" && i + 2 < argc) {
+            options.width = std::max(1, std::atoi(argv[++i]));
+            options.height = std::max(1, std::atoi(argv[++i]));
+        } else {
+            std::cerr << "unknown argument " << arg << std::endl;
+        }
+    }
+    return options;
+}
+
+#ifdef HEADLESS_EGL
+
+namespace {
+EGLDisplay egl_display = EGL_NO_DISPLAY;
+EGLSurface egl_surface = EGL_NO_SURFACE;
+EGLContext egl_context = EGL_NO_CONTEXT;
+
+EGLDisplay get_display() {
+    // surfaceless platform does not need X or a DRM master, so it works on render farm boxes
+    const char* client_extensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+    auto get_platform_display = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+    if (client_extensions != NULL && get_platform_display != NULL
+        && std::strstr(client_extensions, "EGL_MESA_platform_surfaceless") != NULL) {
+        EGLDisplay display = get_platform_display(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+        if (display != EGL_NO_DISPLAY)
+            return display;
+    }
+    return eglGetDisplay(EGL_DEFAULT_DISPLAY);
+}
+}
+
+bool init_headless_context(int width, int height) {
+    egl_display = get_display();
+
+    EGLint major, minor;
+    if (egl_display == EGL_NO_DISPLAY || !eglInitialize(egl_display, &major, &minor)) {
+        std::cerr << "failed to initialize EGL display\n";
+        return false;
+    }
+    std::cerr << "egl " << major << '.' << minor << " init\n";
+
+    const EGLint config_attribs[] = {
+        EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+        EGL_RED_SIZE, 8,
+        EGL_GREEN_SIZE, 8,
+        EGL_BLUE_SIZE, 8,
+        EGL_ALPHA_SIZE, 8,
+        EGL_DEPTH_SIZE, 24,
+        EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+        EGL_NONE
+    };
+    EGLConfig config;
+    EGLint config_count = 0;
+    if (!eglChooseConfig(egl_display, config_attribs, &config, 1, &config_count) || config_count == 0) {
+        std::cerr << "no suitable EGL config\n";
+        return false;
+    }
+
+    const EGLint pbuffer_attribs[] = { EGL_WIDTH, width, EGL_HEIGHT, height, EGL_NONE };
+    egl_surface = eglCreatePbufferSurface(egl_display, config, pbuffer_attribs);
+    if (egl_surface == EGL_NO_SURFACE) {
+        std::cerr << "failed to create pbuffer\n";
+        return false;
+    }
+
+    // GL 3.3 core, same as init_window()
+    eglBindAPI(EGL_OPENGL_API);
+    const EGLint context_attribs[] = {
+        EGL_CONTEXT_MAJOR_VERSION, 3,
+        EGL_CONTEXT_MINOR_VERSION, 3,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+        EGL_NONE
+    };
+    egl_context = eglCreateContext(egl_display, config, EGL_NO_CONTEXT, context_attribs);
+    if (egl_context == EGL_NO_CONTEXT || !eglMakeCurrent(egl_display, egl_surface, egl_surface, egl_context)) {
+        std::cerr << "failed to create EGL context\n";
+        return false;
+    }
+
+    // glew looks for a GLX display after loading the core functions, there is none here
+    glewExperimental = GL_TRUE;
+    GLenum glew_status = glewInit();
+#ifdef GLEW_ERROR_NO_GLX_DISPLAY
+    if (glew_status == GLEW_ERROR_NO_GLX_DISPLAY)
+        glew_status = GLEW_OK;
+#endif
+    if (glew_status != GLEW_OK) {
+        std::cerr << "Failed to initialize OpenGL loader!\n";
+        return false;
+    }
+    std::cerr << "headless " << glGetString(GL_RENDERER) << ' ' << width << 'x' << height << '\n';
+
+    return true;
+}
+
+void destroy_headless_context() {
+    if (egl_display == EGL_NO_DISPLAY)
+        return;
+    eglMakeCurrent(egl_display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    if (egl_context != EGL_NO_CONTEXT)
+        eglDestroyContext(egl_display, egl_context);
+    if (egl_surface != EGL_NO_SURFACE)
+        eglDestroySurface(egl_display, egl_surface);
+    eglTerminate(egl_display);
+    egl_display = EGL_NO_DISPLAY;
+}
+
+#else
+
+bool init_headless_context(int, int) {
+    std::cerr << "built without EGL, headless mode is unavailable\n";
+    return false;
+}
+
+void destroy_headless_context() {}
+
+#endif
+
+FrameTimes::FrameTimes(size_t frames)
+    : queries(2 * frames) {
+    if (!queries.empty())
+        glGenQueries(queries.size(), &queries[0]);
+    cpu_ms.reserve(frames);
+}
+
+FrameTimes::~FrameTimes() {
+    if (!queries.empty())
+        glDeleteQueries(queries.size(), &queries[0]);
+}
+
+void FrameTimes::begin_frame() {
+    frame_start = std::chrono::steady_clock::now();
+    if (2 * cpu_ms.size() < queries.size())
+        glQueryCounter(queries[2 * cpu_ms.size()], GL_TIMESTAMP);
+}
+
+void FrameTimes::end_frame() {
+    if (2 * cpu_ms.size() >= queries.size())
+        return;
+    glQueryCounter(queries[2 * cpu_ms.size() + 1], GL_TIMESTAMP);
+    cpu_ms.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - frame_start).count());
+}
+
+void FrameTimes::write_csv(const std::string& filename) {
+    std::vector<double> gpu_ms(cpu_ms.size());
+    for (size_t i = 0; i < cpu_ms.size(); i++) {
+        GLuint64 start, end;
+        glGetQueryObjectui64v(queries[2 * i], GL_QUERY_RESULT, &start);
+        glGetQueryObjectui64v(queries[2 * i + 1], GL_QUERY_RESULT, &end);
+        gpu_ms[i] = (end - start) / 1e6;
+    }
+
+    std::ofstream file(filename);
+    file << "frame,cpu_ms,gpu_ms\n";
+    for (size_t i = 0; i < cpu_ms.size(); i++) {
+        file << i << ',' << cpu_ms[i] << ',' << gpu_ms[i] << '\n';
+    }
+
+    if (!cpu_ms.empty()) {
+        double cpu_avg = std::accumulate(cpu_ms.begin(), cpu_ms.end(), 0.0) / cpu_ms.size();
+        double gpu_avg = std::accumulate(gpu_ms.begin(), gpu_ms.end(), 0.0) / gpu_ms.size();
+        std::cout << cpu_ms.size() << " frames, avg cpu " << cpu_avg << " ms, avg gpu " << gpu_avg << " ms -> " << filename << std::endl;
+    }
+}
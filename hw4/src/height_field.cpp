@@ -0,0 +1,148 @@
+#include "height_field.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+
+#include "gl_state.h"
+#include "sampler_cache.h"
+
+namespace {
+// (min, max) heights per level, exact texels. Outside the square is below everything
+const SamplerState HEIGHT_SAMPLER = { GL_NEAREST_MIPMAP_NEAREST, GL_NEAREST, GL_CLAMP_TO_BORDER, GL_NONE, GL_LEQUAL, { -1e30f, -1e30f, -1e30f, -1e30f } };
+}
+
+HeightField::HeightField(size_t resolution, glm::vec2 center, float radius, float bottom, float top)
+    : resolution(resolution)
+    , corner(center - glm::vec2(radius, radius))
+    , size(2 * radius)
+    , bottom(bottom)
+    , top(top) {
+
+    // x along x, y along z: the square's rows are the framebuffer rows
+    view = glm::ortho(-radius, radius, radius, -radius, 0.0f, top - bottom) *
+           glm::lookAt(glm::vec3(center.x, top, center.y), glm::vec3(center.x, bottom, center.y), glm::vec3(0, 0, -1));
+
+    glGenTextures(1, &depth_map);
+    gl_state::bind_texture(0, GL_TEXTURE_2D, depth_map);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT32F, resolution, resolution, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+    glGenFramebuffers(1, &depth_buffer);
+    gl_state::bind_framebuffer(depth_buffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depth_map, 0);
+    glDrawBuffer(GL_NONE);
+    glReadBuffer(GL_NONE);
+    gl_state::bind_framebuffer(0);
+
+    glGenTextures(1, &texture);
+
+    // flat at the bottom until baked
+    for (size_t level_size = resolution; level_size > 0; level_size /= 2) {
+        levels.push_back({ level_size, std::vector<glm::vec2>(level_size * level_size, glm::vec2(bottom, bottom)) });
+    }
+}
+
+HeightField::~HeightField() {
+    gl_state::forget_texture(depth_map);
+    gl_state::forget_texture(texture);
+    glDeleteTextures(1, &depth_map);
+    glDeleteTextures(1, &texture);
+    glDeleteFramebuffers(1, &depth_buffer);
+}
+
+bool HeightField::begin_bake(const std::vector<ShadowCaster>& casters) {
+    if (!cache.update(view, casters))
+        return false;
+
+    gl_state::viewport(0, 0, resolution, resolution);
+    gl_state::bind_framebuffer(depth_buffer);
+    gl_state::set_enabled(GL_DEPTH_TEST, true);
+    glClear(GL_DEPTH_BUFFER_BIT);
+    return true;
+}
+
+void HeightField::end_bake() {
+    auto start = std::chrono::steady_clock::now();
+
+    std::vector<float> depth(resolution * resolution);
+    glReadPixels(0, 0, resolution, resolution, GL_DEPTH_COMPONENT, GL_FLOAT, depth.data());
+    gl_state::bind_framebuffer(0);
+
+    std::vector<glm::vec2>& cells = levels[0].cells;
+    for (size_t i = 0; i < depth.size(); i++) {
+        float height = top - depth[i] * (top - bottom);
+        cells[i] = glm::vec2(height, height);
+    }
+    for (size_t l = 1; l < levels.size(); l++) {
+        const Level& in = levels[l - 1];
+        Level& out = levels[l];
+        for (size_t z = 0; z < out.size; z++) {
+            for (size_t x = 0; x < out.size; x++) {
+                glm::vec2 range = in.cells[2 * z * in.size + 2 * x];
+                for (size_t i = 1; i < 4; i++) {
+                    glm::vec2 child = in.cells[(2 * z + i / 2) * in.size + 2 * x + i % 2];
+                    range = glm::vec2(std::min(range.x, child.x), std::max(range.y, child.y));
+                }
+                out.cells[z * out.size + x] = range;
+            }
+        }
+    }
+
+    gl_state::bind_texture(0, GL_TEXTURE_2D, texture);
+    for (size_t l = 0; l < levels.size(); l++) {
+        glTexImage2D(GL_TEXTURE_2D, l, GL_RG32F, levels[l].size, levels[l].size, 0, GL_RG, GL_FLOAT, levels[l].cells.data());
+    }
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels.size() - 1);
+
+    std::cout << "height field baked in " << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() << " ms" << std::endl;
+}
+
+glm::vec2 HeightField::cell_range(size_t level, long x, long z) const {
+    const Level& l = levels[level];
+    if (x < 0 || z < 0 || x >= long(l.size) || z >= long(l.size))
+        return glm::vec2(bottom, bottom);
+    return l.cells[z * l.size + x];
+}
+
+float HeightField::height(float x, float z) const {
+    long cx = long(std::floor((x - corner.x) / size * resolution));
+    long cz = long(std::floor((z - corner.y) / size * resolution));
+    return cell_range(0, cx, cz).y;
+}
+
+float HeightField::max_height(glm::vec2 min_xz, glm::vec2 max_xz) const {
+    long x0 = long(std::floor((min_xz.x - corner.x) / size * resolution));
+    long z0 = long(std::floor((min_xz.y - corner.y) / size * resolution));
+    long x1 = long(std::floor((max_xz.x - corner.x) / size * resolution));
+    long z1 = long(std::floor((max_xz.y - corner.y) / size * resolution));
+    long last = long(resolution) - 1;
+    if (x1 < 0 || z1 < 0 || x0 > last || z0 > last)
+        return bottom;
+    x0 = std::max(x0, 0L);
+    z0 = std::max(z0, 0L);
+    x1 = std::min(x1, last);
+    z1 = std::min(z1, last);
+    size_t level = 0;
+    while (level + 1 < levels.size() && ((x1 >> level) - (x0 >> level) > 1 || (z1 >> level) - (z0 >> level) > 1)) {
+        level++;
+    }
+    float result = bottom;
+    for (long z = z0 >> level; z <= z1 >> level; z++) {
+        for (long x = x0 >> level; x <= x1 >> level; x++) {
+            result = std::max(result, cell_range(level, x, z).y);
+        }
+    }
+    return result;
+}
+
+void HeightField::bind_texture(unsigned int slot) {
+    gl_state::bind_texture(slot, GL_TEXTURE_2D, texture);
+    bind_sampler(slot, HEIGHT_SAMPLER);
+}
+
+glm::vec3 HeightField::area() const {
+    return glm::vec3(corner, 1 / size);
+}
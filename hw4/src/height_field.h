@@ -0,0 +1,60 @@
+#pragma once
+
+#include <vector>
+
+#include <GL/glew.h>
+
+#include <glm/glm.hpp>
+
+#include "glconfig.h"
+
+// Highest static surface over every cell of a square around center, seen from above. Baked with one depth
+// render when the casters change, read back and kept on the CPU for queries such as particle collision,
+// and as an RG32F texture of (min, max) heights with min-max mip levels, e.g. for the droplet geometry
+// shader. Cells with nothing over the bottom are at the bottom.
+// GL thread only
+class HeightField {
+  public:
+    // resolution a power of two
+    HeightField(size_t resolution, glm::vec2 center, float radius, float bottom, float top);
+    ~HeightField();
+
+    // true if casters changed since the last bake, the depth target is then bound and cleared: draw the
+    // casters with view and call end_bake(). Otherwise nothing is bound
+    bool begin_bake(const std::vector<ShadowCaster>& casters);
+    // reads the depth back and rebuilds the levels and the texture
+    void end_bake();
+
+    // top of the cell under x, z, bottom outside the square
+    float height(float x, float z) const;
+    // highest surface over the rectangle, answered from the coarsest level whose cells cover it in 2x2
+    float max_height(glm::vec2 min_xz, glm::vec2 max_xz) const;
+
+    void bind_texture(unsigned int slot);
+    // xz of the square's corner and 1 / its size, uv = (xz - area.xy) * area.z
+    glm::vec3 area() const;
+
+    // ortho projection from above the top, draw the casters with it
+    glm::mat4 view;
+
+  private:
+    struct Level {
+        size_t size;
+        // min, max per cell, rows along z
+        std::vector<glm::vec2> cells;
+    };
+
+    glm::vec2 cell_range(size_t level, long x, long z) const;
+
+    const size_t resolution;
+    const glm::vec2 corner;
+    const float size;
+    const float bottom, top;
+
+    std::vector<Level> levels;
+    ShadowCache cache;
+
+    GLuint depth_map;
+    GLuint depth_buffer;
+    GLuint texture;
+};
@@ -24,20 +24,33 @@
 #include <glm/gtc/type_ptr.hpp>
 #include <glm/gtx/transform.hpp>
 
+#include "asset_manager.h"
 #include "droplet.h"
+#include "gl_state.h"
 #include "glconfig.h"
+#include "headless.h"
+#include "height_field.h"
 #include "opengl_shader.h"
+#include "profiler.h"
+#include "sampler_cache.h"
+#include "shader_permutations.h"
+#include "shader_watcher.h"
+#include "uniform_blocks.h"
 
 // STB, load images
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb_image.h>
-// obj loader implementation
-#define TINYOBJLOADER_IMPLEMENTATION
-#include "tiny_obj_loader.h"
 
 const double FPS_CAP = 144;
 const double FRAME_DURATION_NSECONDS = 1e9 / FPS_CAP;
 const int FRAMES_MEASURE = 10;
+// time for GL uploads of streamed assets each frame
+const double ASSET_UPLOAD_BUDGET_MS = 4;
+// estimated video memory of loaded textures before released ones are deleted
+const size_t TEXTURE_BUDGET_BYTES = size_t(256) << 20;
+
+const SamplerState SKYBOX_SAMPLER = { GL_LINEAR, GL_LINEAR, GL_CLAMP_TO_EDGE, GL_NONE, GL_LEQUAL, { 0, 0, 0, 0 } };
+const SamplerState DROPLET_SAMPLER = { GL_LINEAR_MIPMAP_LINEAR, GL_LINEAR, GL_REPEAT, GL_NONE, GL_LEQUAL, { 0, 0, 0, 0 } };
 
 int fps = -1;
 
@@ -120,144 +133,35 @@ void create_skybox(GLuint &vbo, GLuint &vao, GLuint &ebo) {
     glBindVertexArray(0);
 }
 
-/// @returns number of triangles
-std::vector<Mesh> create_object(const tinyobj::attrib_t &attrib, const std::vector<tinyobj::shape_t> &shapes, const std::vector<Material> &materials) {
-
-    std::vector<Mesh> meshes;
-    meshes.reserve(shapes.size());
-
-    for (const tinyobj::shape_t &shape : shapes) {
-        size_t vertex_count = 0;
-        size_t face_count = 0;
-        std::vector<float> vertices;
-        std::vector<unsigned int> indices;
-
-        size_t index = 0;
-        for (auto face_size : shape.mesh.num_face_vertices) {
-            if (face_size != 3) {
-                std::cerr << "!!! face size = " << face_size << " !!!\n";
-                exit(1);
-            }
-            face_count++;
-
-            glm::vec3 vert[3];
-            for (size_t vi = 0; vi < 3; vi++) {
-                size_t pos = 3 * shape.mesh.indices[index + vi].vertex_index;
-                vert[vi].x = attrib.vertices[pos + 0];
-                vert[vi].y = attrib.vertices[pos + 1];
-                vert[vi].z = attrib.vertices[pos + 2];
-            }
-            glm::vec3 def_normal = glm::normalize(glm::cross(vert[2] - vert[0], vert[1] - vert[0]));
-
-            for (size_t vi = 0; vi < face_size; vi++, index++) {
-                indices.push_back(vertex_count++);
-                tinyobj::index_t idx = shape.mesh.indices[index];
-
-                auto start = attrib.vertices.begin() + 3 * shape.mesh.indices[index].vertex_index;
-                std::copy(start, start + 3, std::back_insert_iterator<std::vector<float>>(vertices));
-                if (!attrib.normals.empty()) {
-                    auto start2 = attrib.normals.begin() + 3 * shape.mesh.indices[index].normal_index;
-                    std::copy(start2, start2 + 3, std::back_insert_iterator<std::vector<float>>(vertices));
-                } else {
-                    // use default normal
-                    vertices.push_back(def_normal.x);
-                    vertices.push_back(def_normal.y);
-                    vertices.push_back(def_normal.z);
-                }
-
-                tinyobj::real_t tx = attrib.texcoords[2 * idx.texcoord_index + 0];
-                tinyobj::real_t ty = attrib.texcoords[2 * idx.texcoord_index + 1];
-                vertices.push_back(tx);
-                vertices.push_back(ty);
-            }
-        }
-
-        meshes.emplace_back(vertices, indices, std::vector<Material> { materials[shape.mesh.material_ids[0]] }, std::vector<size_t> { 3, 3, 2 });
-    }
-
-    return meshes;
-}
-
-void load_cubemap(GLuint &texture) {
-    std::string filenames[] = {
-        "assets/Bridge/posx.jpg",
-        "assets/Bridge/negx.jpg",
-        "assets/Bridge/posy.jpg",
-        "assets/Bridge/negy.jpg",
-        "assets/Bridge/posz.jpg",
-        "assets/Bridge/negz.jpg"
-
-        // "assets/SaintLazarusChurch/posx.jpg",
-        // "assets/SaintLazarusChurch/negx.jpg",
-        // "assets/SaintLazarusChurch/posy.jpg",
-        // "assets/SaintLazarusChurch/negy.jpg",
-        // "assets/SaintLazarusChurch/posz.jpg",
-        // "assets/SaintLazarusChurch/negz.jpg"
-
-        // "assets/sky/px.png",
-        // "assets/sky/nx.png",
-        // "assets/sky/py.png",
-        // "assets/sky/ny.png",
-        // "assets/sky/pz.png",
-        // "assets/sky/nz.png"
-
-        // "assets/testcube/positive-x.tga",
-        // "assets/testcube/negative-x.tga",
-        // "assets/testcube/positive-y.tga",
-        // "assets/testcube/negative-y.tga",
-        // "assets/testcube/positive-z.tga",
-        // "assets/testcube/negative-z.tga"
-    };
-
-    glGenTextures(1, &texture);
-    glBindTexture(GL_TEXTURE_CUBE_MAP, texture);
-
-    stbi_set_flip_vertically_on_load(false);
-
-    int width, height, channels;
-    for (int i = 0; i < 6; i++) {
-        unsigned char *image = stbi_load(filenames[i].c_str(),
-                                         &width,
-                                         &height,
-                                         &channels,
-                                         STBI_rgb);
-
-        std::cout << "loaded " << width << " * " << height << " cubemap face" << std::endl;
-
-        glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB8, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, image);
-        stbi_image_free(image);
-    }
-}
-
-std::vector<Mesh> load_object(std::string path, std::string filename) {
-    tinyobj::attrib_t attrib;
-    std::vector<tinyobj::shape_t> shapes;
-    std::vector<tinyobj::material_t> materials;
-
-    std::string warn, err;
-    bool ret = tinyobj::LoadObj(&attrib, &shapes, &materials, &err, filename.c_str());
-
-    if (!warn.empty()) {
-        std::cout << warn << std::endl;
-    }
-    if (!err.empty()) {
-        std::cerr << err << std::endl;
-    }
-
-    if (!ret) { throw "failed loading"; }
-
-    std::vector<Material> mats;
-    for (size_t i = 0; i < materials.size(); i++) {
-        auto &material = materials[i];
-        if (material.diffuse_texname != "") {
-            mats.emplace_back(std::string(path) + material.diffuse_texname);
-        } else {
-            mats.emplace_back(material.diffuse);
-        }
-    }
-
-    return create_object(attrib, shapes, mats);
-}
+const std::vector<std::string> CUBEMAP_FILENAMES = {
+    "assets/Bridge/posx.jpg",
+    "assets/Bridge/negx.jpg",
+    "assets/Bridge/posy.jpg",
+    "assets/Bridge/negy.jpg",
+    "assets/Bridge/posz.jpg",
+    "assets/Bridge/negz.jpg"
+
+    // "assets/SaintLazarusChurch/posx.jpg",
+    // "assets/SaintLazarusChurch/negx.jpg",
+    // "assets/SaintLazarusChurch/posy.jpg",
+    // "assets/SaintLazarusChurch/negy.jpg",
+    // "assets/SaintLazarusChurch/posz.jpg",
+    // "assets/SaintLazarusChurch/negz.jpg"
+
+    // "assets/sky/px.png",
+    // "assets/sky/nx.png",
+    // "assets/sky/py.png",
+    // "assets/sky/ny.png",
+    // "assets/sky/pz.png",
+    // "assets/sky/nz.png"
+
+    // "assets/testcube/positive-x.tga",
+    // "assets/testcube/negative-x.tga",
+    // "assets/testcube/positive-y.tga",
+    // "assets/testcube/negative-y.tga",
+    // "assets/testcube/positive-z.tga",
+    // "assets/testcube/negative-z.tga"
+};
 
 const float SCROLL_STEP = 0.05;
 const float MOUSE_SENS = 0.005;
@@ -301,7 +205,8 @@ void mouse_callback(GLFWwindow *window, double xpos, double ypos) {
     cursor_position[1] = ypos;
 }
 
-Mesh ground() {
+
+Mesh ground(AssetManager &assets) {
     float dist = 30;
     std::vector<float> v;
     for (int dx = -1; dx <= 1; dx += 2) {
@@ -321,44 +226,66 @@ Mesh ground() {
 
     std::vector<unsigned int> indices { 0, 1, 2, 2, 3, 1 };
     std::reverse(indices.begin(), indices.end());
-    std::vector<Material> mats = { Material("assets/bonsai/soil.jpg") };
+    std::vector<Material> mats = { Material(assets.texture("assets/bonsai/soil.jpg")) };
 
     return Mesh(v, indices, mats, std::vector<size_t> { 3, 3, 2 });
 }
 
-int main(int, char **) {
-    GLFWwindow *window = init_window();
+int main(int argc, char **argv) {
+    HeadlessOptions headless = parse_headless_options(argc, argv);
+
+    GLFWwindow *window = NULL;
+    if (headless.enabled) {
+        if (!init_headless_context(headless.width, headless.height))
+            return 1;
+    } else {
+        window = init_window();
+    }
+
+    // textures and models stream in while the first frames are drawn with placeholders
+    AssetManager assets;
+    assets.textures().set_budget(TEXTURE_BUDGET_BYTES);
 
-    // std::vector<Mesh> tent_meshes = load_object("assets/tent/", "Market.obj");
-    std::vector<Mesh> tent_meshes = load_object("assets/black_smith/", "black_smith.obj");
+    // std::vector<Mesh> &tent_meshes = assets.object("assets/tent/", "Market.obj");
+    std::vector<Mesh> &tent_meshes = assets.object("assets/black_smith/", "black_smith.obj");
     glm::vec3 tent_position(0, 1.3, 0);
 
-    // std::vector<Mesh> all_ground_meshes22 = load_object("assets/bonsai/", "bonsai-tree.obj");
-    std::vector<Mesh> all_ground_meshes = { ground() };
+    // std::vector<Mesh> &all_ground_meshes22 = assets.object("assets/bonsai/", "bonsai-tree.obj");
+    std::vector<Mesh> all_ground_meshes = { ground(assets) };
     std::vector<Mesh *> ground_meshes = { &all_ground_meshes[0] };
 
-    GLuint cubemap_texture;
-    load_cubemap(cubemap_texture);
+    TextureRef cubemap_texture = assets.cubemap(CUBEMAP_FILENAMES);
 
-    GLuint droplet_tex;
-    load_image(droplet_tex, "assets/droplet.png");
+    // droplets.fs reads .x as an alpha mask, data and not a color
+    TextureRef droplet_tex = assets.texture("assets/droplet.png", true, true);
 
     // create our geometries
     GLuint vbo, vao, ebo;
     create_skybox(vbo, vao, ebo);
 
-    // init shaders
+    // init shaders, linked programs are reused from shader_cache/ when the sources did not change
+    auto const shaders_start = std::chrono::steady_clock::now();
     shader_t skybox_shader("assets/skybox.vs", "assets/skybox.fs");
     shader_t droplet_shader("assets/droplets.vs", "assets/droplets.fs", "assets/droplets.gs");
-    shader_t object_shader("assets/object.vs", "assets/object.fs");
     shader_t id_shader("assets/id.vs", "assets/id.fs");
 
-    std::cerr << "shaders done\n";
+    // lit objects are compiled per feature set, the sampler units are the same for every variant
+    ShaderPermutations object_shaders("assets/object.vs", "assets/object.fs", [](shader_t &shader) {
+        shader.set_uniform("u_cube", 0);
+        shader.set_uniform("dl_depth", 10);
+    });
+    uniform_handle<glm::mat4> id_mvp = id_shader.get_handle<glm::mat4>("u_mvp");
 
-    setup_imgui(window);
+    // camera and lights are shared by all programs through these
+    UniformBlock<CameraBlock> camera_block("Camera");
+    UniformBlock<LightsBlock> lights_block("Lights");
 
-    glfwSetScrollCallback(window, &scroll_callback);
-    glfwSetCursorPosCallback(window, &mouse_callback);
+    if (!headless.enabled) {
+        setup_imgui(window);
+
+        glfwSetScrollCallback(window, &scroll_callback);
+        glfwSetCursorPosCallback(window, &mouse_callback);
+    }
 
     glEnable(GL_BLEND);
     glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
@@ -367,31 +294,88 @@ int main(int, char **) {
 
     float r = 0.7, R = 5, height_mult = 0.8, badrock_height = 0.3;
 
-    Shadow sun_shadow = Shadow(2048 * 4, 2048 * 4);
-
-    Shadow height_map = Shadow(512, 512);
+    // cascades follow the camera, 16 MB instead of a single 8192^2 map over the whole scene, PCF hides the texels
+    CascadedShadow sun_shadow(1024, SHADOW_CASCADES);
 
     float max_radius = 50;
 
+    // static geometry seen from above, kills the drops under it. Baked again only when the scene changes
+    HeightField rain_heights(1024, glm::vec2(0, 0), max_radius, 10 - max_radius, 10 + max_radius);
+
     // controls
     static float fovy = 90;
     static float sun_speed_log = -20;
     static float sun_start_a = 3.4;
     static float camera_radius_mult = 1;
     static float droplet_speed = 7.0;
+    static bool texture_gamma_correction = true;
+    static bool blend_gamma_correction = true;
+    static bool shadows_enabled = true;
+    // a shader_features::PCF_ kernel
+    static int shadow_filter = shader_features::PCF_POISSON;
+
+    // one sun, no spot lights
+    auto object_features = [&]() {
+        unsigned features = shader_features::dl_count(1) | shader_features::pd_count(0);
+        if (texture_gamma_correction)
+            features |= shader_features::TEX_GAMMA_CORRECT;
+        if (blend_gamma_correction)
+            features |= shader_features::BLEND_GAMMA_CORRECT;
+        if (shadows_enabled)
+            features |= shader_features::SHADOWS | shader_features::pcf(shadow_filter);
+        return features;
+    };
+    object_shaders.get(object_features());
+    std::cerr << "shaders done in " << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - shaders_start).count() << " ms\n";
+
+    // edited shader files are recompiled between frames, the benchmark keeps the programs fixed
+    ShaderWatcher shader_watcher;
+    if (!headless.enabled) {
+        shader_watcher.watch(skybox_shader);
+        shader_watcher.watch(droplet_shader);
+        shader_watcher.watch(id_shader);
+        shader_watcher.watch(object_shaders);
+    }
 
     float rain_tile_size = 7;
     float rain_height = 5;
     Droplets droplets(700 * 4, rain_tile_size, rain_height);
 
-    while (!glfwWindowShouldClose(window)) {
+    // the benchmark measures the complete scene
+    if (headless.enabled)
+        assets.finish();
+
+    FrameTimes frame_times(headless.enabled ? headless.frames : 0);
+    int frame_index = 0;
+
+    Profiler profiler;
+    shader_t::upload_stats = uniform_upload_stats();
 
-        glfwPollEvents();
+    while (headless.enabled ? frame_index < headless.frames : !glfwWindowShouldClose(window)) {
+        frame_times.begin_frame();
+        profiler.begin_frame();
+        // imgui and the setup code change GL state behind the tracker
+        gl_state::invalidate();
+        assets.update(ASSET_UPLOAD_BUDGET_MS);
 
         // Get windows size
         int display_w, display_h;
-        glfwGetFramebufferSize(window, &display_w, &display_h);
-        float const time_from_start = (float)(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start_time).count() / 1000.0);
+        float time_from_start;
+        if (headless.enabled) {
+            display_w = headless.width;
+            display_h = headless.height;
+            time_from_start = frame_index / 60.0f;
+
+            // fixed camera path: one circle around the tent looking at it
+            float path_a = 2 * M_PI * frame_index / headless.frames;
+            player_pos = glm::vec3(4 * cosf(path_a), 0.7, 4 * sinf(path_a));
+            player_look_dir = glm::normalize(tent_position - player_pos);
+        } else {
+            glfwPollEvents();
+            shader_watcher.poll();
+            glfwGetFramebufferSize(window, &display_w, &display_h);
+            time_from_start = (float)(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start_time).count() / 1000.0);
+        }
 
         glm::mat4 sun_rotation = glm::rotate(
             sun_start_a + time_from_start * 2 * float(M_PI) * powf(2, sun_speed_log),
@@ -417,7 +401,8 @@ int main(int, char **) {
             camera_position,
             camera_lookat,
             camera_up);
-        auto projection = glm::perspective<float>(glm::radians(fovy), float(display_w) / display_h, 0.1, 100);
+        const float z_near = 0.1, z_far = 100;
+        auto projection = glm::perspective<float>(glm::radians(fovy), float(display_w) / display_h, z_near, z_far);
         // std::cerr << fovy << std::endl;
         auto mvp = projection * view * model;
         auto vp = projection * view;
@@ -426,137 +411,127 @@ int main(int, char **) {
         auto tent_mvp = projection * view * tent_model;
         auto ground_mvp = projection * view * ground_model;
 
+        // the tent and the ground never move, the shadow maps and the rain height field are only drawn again
+        // when their view moved or meshes finished loading
+        std::vector<ShadowCaster> static_casters = { { tent_model, tent_meshes.size() }, { ground_model, ground_meshes.size() } };
+        size_t shadow_draws = 0;
+
         // get sun shadow
-        sun_shadow.set_shadow(
-            glm::ortho(-max_radius, max_radius, -max_radius, max_radius, -max_radius, max_radius) * glm::lookAt(sun_position, glm::vec3(0, 0, 0), glm::vec3(0, 1, 0)));
-        
+        profiler.begin_pass("sun shadow");
+        sun_shadow.fit(view, glm::radians(fovy), float(display_w) / display_h, z_near, z_far, sun_position, glm::vec3(0, 0, 0), max_radius);
+
         id_shader.use();
-        {
-            glm::mat4 shadow_mvp = sun_shadow.view * tent_model;
-            id_shader.set_uniform("u_mvp", glm::value_ptr(shadow_mvp));
+        for (size_t c = 0; c < SHADOW_CASCADES; c++) {
+            if (!sun_shadow.set_static_cascade(c, static_casters))
+                continue;
+            shadow_draws++;
+            glm::mat4 shadow_mvp = sun_shadow.views[c] * tent_model;
+            id_shader.set_uniform(id_mvp, shadow_mvp);
             for (Mesh &mesh : tent_meshes) {
                 mesh.draw();
             }
-            shadow_mvp = sun_shadow.view * ground_model;
-            id_shader.set_uniform("u_mvp", glm::value_ptr(shadow_mvp));
+            shadow_mvp = sun_shadow.views[c] * ground_model;
+            id_shader.set_uniform(id_mvp, shadow_mvp);
             for (Mesh *mesh : ground_meshes) {
                 mesh->draw();
             }
         }
         sun_shadow.unset_shadow();
+        profiler.end_pass();
 
-        height_map.set_shadow(
-            glm::ortho(-max_radius, max_radius, -max_radius, max_radius, -max_radius, max_radius) * glm::lookAt(glm::vec3(0, 10, 0), glm::vec3(0, 0, 0), glm::vec3(1, 0, 0)));
-
-        id_shader.use();
-        {
-            glm::mat4 shadow_mvp = height_map.view * tent_model;
-            id_shader.set_uniform("u_mvp", glm::value_ptr(shadow_mvp));
+        profiler.begin_pass("height field");
+        if (rain_heights.begin_bake(static_casters)) {
+            id_shader.use();
+            glm::mat4 shadow_mvp = rain_heights.view * tent_model;
+            id_shader.set_uniform(id_mvp, shadow_mvp);
             for (Mesh &mesh : tent_meshes) {
                 mesh.draw();
             }
-            shadow_mvp = height_map.view * ground_model;
-            id_shader.set_uniform("u_mvp", glm::value_ptr(shadow_mvp));
+            shadow_mvp = rain_heights.view * ground_model;
+            id_shader.set_uniform(id_mvp, shadow_mvp);
             for (Mesh *mesh : ground_meshes) {
                 mesh->draw();
             }
+            rain_heights.end_bake();
         }
-        height_map.unset_shadow();
+        profiler.end_pass();
+
+        camera_block.value.u_vp = vp;
+        camera_block.value.u_cam = camera_position;
+        camera_block.value.u_cam_forward = camera_forward;
+        camera_block.upload();
+
+        LightsBlock &lights = lights_block.value;
+        lights.background_light = glm::vec3(1, 1, 1) * 0.8f;
+        lights.dl_num = 1;
+        lights.dl_dir[0] = glm::vec4(sun_position, 0);
+        lights.dl_light[0] = glm::vec4(1.0f, 1.0f, 1.0f, 0);
+        for (size_t c = 0; c < SHADOW_CASCADES; c++) {
+            lights.dl_vp[c] = sun_shadow.views[c];
+        }
+        lights.pd_num = 0;
+        lights_block.upload();
 
         // start actual drawing
 
         // Set viewport to fill the whole window area
-        glViewport(0, 0, display_w, display_h);
+        gl_state::viewport(0, 0, display_w, display_h);
 
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-        glEnable(GL_DEPTH_TEST);
-        glDepthFunc(GL_LEQUAL);
-
-        // Gui start new frame
-        ImGui_ImplOpenGL3_NewFrame();
-        ImGui_ImplGlfw_NewFrame();
-        ImGui::NewFrame();
-
-        // GUI
-        ImGui::Begin("GUI");
-        ImGui::Text("FPS: %d", fps);
-        ImGui::SliderFloat("fovy", &fovy, 1, 180);
-        ImGui::SliderFloat("sun start a", &sun_start_a, 0, 2 * M_PI);
-        ImGui::SliderFloat("sun speed log", &sun_speed_log, -20, 0);
-        ImGui::SliderFloat("camera radius", &camera_radius_mult, 0.5, 5);
-
-        ImGui::SliderFloat("droplet speed", &droplet_speed, 0.1, 30);
-        droplets.speed = droplet_speed;
+        gl_state::set_enabled(GL_DEPTH_TEST, true);
+        gl_state::depth_func(GL_LEQUAL);
 
-        static bool texture_gamma_correction = true;
-        ImGui::Checkbox("texture gamma correction", &texture_gamma_correction);
+        if (!headless.enabled) {
+            // Gui start new frame
+            ImGui_ImplOpenGL3_NewFrame();
+            ImGui_ImplGlfw_NewFrame();
+            ImGui::NewFrame();
 
-        static bool blend_gamma_correction = true;
-        ImGui::Checkbox("blend gamma correction", &blend_gamma_correction);
+            // GUI
+            ImGui::Begin("GUI");
+            ImGui::Text("FPS: %d", fps);
+            ImGui::SliderFloat("fovy", &fovy, 1, 180);
+            ImGui::SliderFloat("sun start a", &sun_start_a, 0, 2 * M_PI);
+            ImGui::SliderFloat("sun speed log", &sun_speed_log, -20, 0);
+            ImGui::SliderFloat("camera radius", &camera_radius_mult, 0.5, 5);
 
-        ImGui::End();
+            ImGui::SliderFloat("droplet speed", &droplet_speed, 0.1, 30);
 
-        skybox_shader.use();
-        skybox_shader.set_uniform("u_mvp", glm::value_ptr(mvp_no_translation));
-        skybox_shader.set_uniform("u_cube", int(0));
-        skybox_shader.set_uniform("dl_num", 1);
-        skybox_shader.set_uniform("dl_dir", sun_position);
-        skybox_shader.set_uniform("dl_light", glm::vec3(1.0f, 1.0f, 1.0f));
-
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_CUBE_MAP, cubemap_texture);
-        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-
-        // Bind vertex array = buffers + indices
-        glBindVertexArray(vao);
-        // Execute draw call
-        glDrawElements(GL_TRIANGLES, 6 * 6, GL_UNSIGNED_INT, 0);
-        glBindTexture(GL_TEXTURE_2D, 0);
-        glBindVertexArray(0);
+            ImGui::Checkbox("texture gamma correction", &texture_gamma_correction);
 
-        // draw tent
+            ImGui::Checkbox("blend gamma correction", &blend_gamma_correction);
 
-        sun_shadow.bind_shadow_texture(10);
+            ImGui::Checkbox("shadows", &shadows_enabled);
 
-        auto pass_everything_lambda = [&](shader_t &shader) {
-            shader.set_uniform("u_cam", camera_position.x, camera_position.y, camera_position.z);
+            ImGui::Combo("shadow filter", &shadow_filter, "hardware 2x2\0rotated grid\0poisson\0");
 
-            shader.set_uniform("u_cube", int(0));
+            profiler.draw_imgui();
 
-            shader.set_uniform("u_tex_gamma_correct", texture_gamma_correction);
-            shader.set_uniform("u_blend_gamma_correct", blend_gamma_correction);
+            ImGui::End();
+        }
+        droplets.speed = droplet_speed;
 
-            shader.set_uniform("dl_num", 1);
-            shader.set_uniform("dl_dir", sun_position);
-            shader.set_uniform("dl_light", glm::vec3(1.0f, 1.0f, 1.0f));
-            shader.set_uniform("dl_depth", 10);
-            shader.set_uniform("dl_vp", glm::value_ptr(sun_shadow.view));
+        profiler.begin_pass("skybox");
+        skybox_shader.use();
+        skybox_shader.set_uniform("u_mvp", glm::value_ptr(mvp_no_translation));
+        skybox_shader.set_uniform("u_cube", int(0));
 
-            shader.set_uniform("pd_num", 0);
-            // shader.set_uniform("pd_dir", torch_dir);
-            // shader.set_uniform("pd_pos", torch_pos);
-            // shader.set_uniform("pd_light", glm::vec3(1.0f, 1.0f, 0.5f) * 0.5f);
-            // shader.set_uniform("pd_angle", 0.6f);
-            // shader.set_uniform("pd_depth", 11);
-            // shader.set_uniform("pd_vp", glm::value_ptr(torch_shadow.view));
+        gl_state::bind_texture(0, GL_TEXTURE_CUBE_MAP, *cubemap_texture);
+        bind_sampler(0, SKYBOX_SAMPLER);
 
-            shader.set_uniform("background_light", glm::vec3(1, 1, 1) * 0.8f);
-        };
+        gl_state::bind_vertex_array(vao);
+        glDrawElements(GL_TRIANGLES, 6 * 6, GL_UNSIGNED_INT, 0);
+        profiler.end_pass();
 
-        object_shader.use();
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_CUBE_MAP, cubemap_texture);
-        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+        // draw tent
+        profiler.begin_pass("objects");
 
-        pass_everything_lambda(object_shader);
+        sun_shadow.bind_shadow_texture(10);
+
+        shader_t &object_shader = object_shaders.get(object_features());
+        object_shader.use();
+        gl_state::bind_texture(0, GL_TEXTURE_CUBE_MAP, *cubemap_texture);
+        bind_sampler(0, SKYBOX_SAMPLER);
 
         object_shader.set_uniform("u_m", glm::value_ptr(tent_model));
         object_shader.set_uniform("u_mvp", glm::value_ptr(tent_mvp));
@@ -573,39 +548,56 @@ int main(int, char **) {
             mesh->draw(object_shader);
         }
 
+        profiler.end_pass();
+
         // draw droplets
+        profiler.begin_pass("droplets");
 
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, droplet_tex);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_R, GL_REPEAT);
+        gl_state::bind_texture(1, GL_TEXTURE_2D, *droplet_tex);
+        bind_sampler(1, DROPLET_SAMPLER);
 
         droplet_shader.use();
 
         
-        height_map.bind_shadow_texture(11);
+        rain_heights.bind_texture(11);
         droplet_shader.set_uniform("u_height_tex", 11);
-        droplet_shader.set_uniform("u_height_view", glm::value_ptr(height_map.view));
-        sun_shadow.bind_shadow_texture(12);
-        droplet_shader.set_uniform("u_shadow_tex", 12);
-        droplet_shader.set_uniform("u_shadow_view", glm::value_ptr(sun_shadow.view));
+        glm::vec3 height_area = rain_heights.area();
+        droplet_shader.set_uniform("u_height_area", height_area.x, height_area.y, height_area.z);
+        // lit through get_shadow_dl like the objects, the cascades are still bound at 10
+        droplet_shader.set_uniform("dl_depth", 10);
 
-        droplet_shader.set_uniform("u_mvp", glm::value_ptr(mvp));
         droplet_shader.set_uniform("tile_size", rain_tile_size);
-        droplet_shader.set_uniform("camera_position", camera_position);
-        droplet_shader.set_uniform("camera_forward", camera_forward);
         droplet_shader.set_uniform("u_droplet_tex", 1);
         
         droplets.draw(droplet_shader, time_from_start);
+        profiler.end_pass();
+
+        profiler.counter("uniform uploads", shader_t::upload_stats.issued);
+        profiler.counter("skipped uniform uploads", shader_t::upload_stats.skipped);
+        profiler.counter("pending assets", assets.pending());
+        profiler.counter("resident textures", assets.textures().count());
+        profiler.counter("texture KB", assets.textures().bytes() >> 10);
+        profiler.counter("state changes", gl_state::stats.issued);
+        profiler.counter("skipped state changes", gl_state::stats.skipped);
+        profiler.counter("shadow maps drawn", shadow_draws);
+        shader_t::upload_stats = uniform_upload_stats();
+        gl_state::stats = gl_state_stats();
+
+        if (headless.enabled) {
+            frame_times.end_frame();
+            frame_index++;
+            continue;
+        }
 
         // Generate gui render commands
+        profiler.begin_pass("imgui");
+        // imgui samples its font on unit 0 with the texture's parameters
+        unbind_sampler(0);
         ImGui::Render();
 
         // Execute gui render commands using OpenGL backend
         ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+        profiler.end_pass();
 
         // Swap the backbuffer with the frontbuffer that is used for screen display
         glfwSwapBuffers(window);
@@ -613,6 +605,13 @@ int main(int, char **) {
         wait_fps_cap();
     }
 
+    if (headless.enabled) {
+        frame_times.write_csv(headless.csv_filename);
+        profiler.dump("pass_times.csv");
+        destroy_headless_context();
+        return 0;
+    }
+
     // Cleanup
     ImGui_ImplOpenGL3_Shutdown();
     ImGui_ImplGlfw_Shutdown();
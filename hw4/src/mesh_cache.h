@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "mapped_file.h"
+
+// Binary mesh files in mesh_cache/, baked from an OBJ on the first load and memory mapped afterwards.
+// Layout: MeshFileHeader, material table, mesh table, then per mesh the interleaved vertex blob
+// (position 3, normal 3, texcoord 2 floats, duplicates welded) and the index blob, both reordered by
+// mesh_optimizer.h. Offsets are from the start of the file
+const uint32_t MESH_FILE_MAGIC = 0x3142534d; // "MSB1"
+const uint32_t MESH_FILE_VERSION = 4;
+const size_t MESH_VERTEX_FLOATS = 8;
+const uint32_t NO_MATERIAL = 0xffffffff;
+
+struct MeshFileHeader {
+    uint32_t magic;
+    uint32_t version;
+    // of the source OBJ, a file baked from an older OBJ is baked again
+    uint64_t source_size;
+    int64_t source_mtime;
+    uint32_t mesh_count;
+    uint32_t material_count;
+    float bounds_min[3];
+    float bounds_max[3];
+};
+
+struct MeshFileMaterial {
+    // relative to the OBJ directory, empty means diffuse color only
+    char texture[256];
+    float diffuse[3];
+    uint32_t pad;
+};
+
+struct MeshFileEntry {
+    uint32_t material;
+    uint32_t vertex_count;
+    uint32_t index_count;
+    uint32_t pad;
+    uint64_t vertex_offset;
+    uint64_t index_offset;
+    float bounds_min[3];
+    float bounds_max[3];
+};
+
+// "mesh_cache/<obj path with / replaced>.mesh"
+std::string mesh_cache_filename(const std::string& obj_filename);
+
+// parses the OBJ (and its MTL) and writes the binary file, needs no GL so it also runs in mesh-baker
+bool bake_mesh(const std::string& obj_filename, const std::string& mesh_filename);
+
+// Read only mapping of a baked file, the vertex and index blobs are uploaded straight from it
+class MeshFile {
+  public:
+    MeshFile() = default;
+    MeshFile(const MeshFile&) = delete;
+    MeshFile& operator=(const MeshFile&) = delete;
+
+    // false if the file is missing, truncated, from another version or older than source_filename.
+    // A missing source is fine, baked files can be shipped without the OBJ
+    bool open(const std::string& mesh_filename, const std::string& source_filename = "");
+    void close();
+
+    const MeshFileHeader& header() const { return *(const MeshFileHeader*)data; }
+    const MeshFileMaterial& material(size_t i) const;
+    const MeshFileEntry& mesh(size_t i) const;
+    const float* vertices(size_t i) const { return (const float*)(data + mesh(i).vertex_offset); }
+    const uint32_t* indices(size_t i) const { return (const uint32_t*)(data + mesh(i).index_offset); }
+
+  private:
+    bool valid() const;
+
+    MappedFile file;
+    // file.data(), while open
+    const unsigned char* data = nullptr;
+};
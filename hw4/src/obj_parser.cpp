@@ -0,0 +1,283 @@
+#include "obj_parser.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <sstream>
+#include <thread>
+#include <unordered_map>
+
+#include "parallel.h"
+
+namespace {
+// smaller pieces are not worth a thread
+const size_t MIN_CHUNK_SIZE = 256 * 1024;
+
+// how a run of faces relates to the faces before it, possibly in the previous chunk
+enum SegmentStart {
+    CONTINUE,
+    NEW_OBJECT,
+    NEW_MATERIAL,
+};
+
+struct Segment {
+    SegmentStart start = CONTINUE;
+    std::string material;
+    std::vector<int> corners;
+};
+
+// a negative OBJ index is relative to the vertices read so far, which includes earlier chunks,
+// so it is fixed up once their sizes are known
+struct RelativeIndex {
+    size_t segment;
+    // into Segment::corners
+    size_t position;
+    int component;
+    long local;
+};
+
+// in read_face, a corner given as a positive index or not at all. Any other value is a valid local index,
+// -1 is the last vertex of an earlier chunk
+const long NOT_RELATIVE = std::numeric_limits<long>::min();
+
+struct Chunk {
+    std::vector<float> attributes[3];
+    std::vector<Segment> segments;
+    std::vector<RelativeIndex> relative_indices;
+    std::vector<std::string> material_libraries;
+};
+
+bool is_space(char c) {
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+const char* skip_space(const char* p, const char* end) {
+    while (p < end && is_space(*p))
+        p++;
+    return p;
+}
+
+std::string rest_of_line(const char* p, const char* end) {
+    p = skip_space(p, end);
+    while (end > p && is_space(end[-1]))
+        end--;
+    return std::string(p, end);
+}
+
+bool keyword(const char*& p, const char* end, const char* word) {
+    size_t length = std::char_traits<char>::length(word);
+    if (size_t(end - p) < length || std::char_traits<char>::compare(p, word, length) != 0)
+        return false;
+    if (p + length < end && !is_space(p[length]))
+        return false;
+    p += length;
+    return true;
+}
+
+void read_floats(const char* p, const char* end, int count, std::vector<float>& out) {
+    for (int i = 0; i < count; i++) {
+        char* next;
+        float value = std::strtof(p, &next);
+        // missing components (e.g. "vt u") are 0
+        if (next == p || next > end) {
+            value = 0;
+            next = (char*)p;
+        }
+        out.push_back(value);
+        p = next;
+    }
+}
+
+// "f v v/t v//n v/t/n ...", fanned into triangles
+void read_face(const char* p, const char* end, Chunk& chunk) {
+    Segment& segment = chunk.segments.back();
+    std::vector<int> polygon;
+    std::vector<long> polygon_relative;
+
+    while (true) {
+        p = skip_space(p, end);
+        if (p >= end || *p == '\n' || *p == '#')
+            break;
+        for (int component = 0; component < 3; component++) {
+            long raw = 0;
+            if (p < end && *p != '/' && !is_space(*p) && *p != '\n') {
+                char* next;
+                raw = std::strtol(p, &next, 10);
+                p = next;
+            }
+            int index = -1;
+            long relative = 0;
+            if (raw > 0) {
+                index = raw - 1;
+            } else if (raw < 0) {
+                relative = long(chunk.attributes[component].size() / (component == 1 ? 2 : 3)) + raw;
+                index = 0;
+            }
+            polygon.push_back(index);
+            polygon_relative.push_back(raw < 0 ? relative : NOT_RELATIVE);
+            if (p < end && *p == '/')
+                p++;
+            else {
+                // the remaining components are missing
+                for (component++; component < 3; component++) {
+                    polygon.push_back(-1);
+                    polygon_relative.push_back(NOT_RELATIVE);
+                }
+            }
+        }
+        while (p < end && !is_space(*p) && *p != '\n')
+            p++;
+    }
+
+    size_t corner_count = polygon.size() / 3;
+    for (size_t i = 1; i + 1 < corner_count; i++) {
+        for (size_t corner : { size_t(0), i, i + 1 }) {
+            for (int component = 0; component < 3; component++) {
+                if (polygon_relative[3 * corner + component] != NOT_RELATIVE) {
+                    chunk.relative_indices.push_back({ chunk.segments.size() - 1, segment.corners.size(), component, polygon_relative[3 * corner + component] });
+                }
+                segment.corners.push_back(polygon[3 * corner + component]);
+            }
+        }
+    }
+}
+
+void parse_chunk(const char* begin, const char* end, Chunk& chunk) {
+    chunk.segments.emplace_back();
+    for (const char* line = begin; line < end;) {
+        const char* line_end = std::find(line, end, '\n');
+        const char* p = skip_space(line, line_end);
+
+        if (keyword(p, line_end, "v")) {
+            read_floats(p, line_end, 3, chunk.attributes[0]);
+        } else if (keyword(p, line_end, "vt")) {
+            read_floats(p, line_end, 2, chunk.attributes[1]);
+        } else if (keyword(p, line_end, "vn")) {
+            read_floats(p, line_end, 3, chunk.attributes[2]);
+        } else if (keyword(p, line_end, "f")) {
+            read_face(p, line_end, chunk);
+        } else if (keyword(p, line_end, "o") || keyword(p, line_end, "g")) {
+            chunk.segments.emplace_back();
+            chunk.segments.back().start = NEW_OBJECT;
+        } else if (keyword(p, line_end, "usemtl")) {
+            chunk.segments.emplace_back();
+            chunk.segments.back().start = NEW_MATERIAL;
+            chunk.segments.back().material = rest_of_line(p, line_end);
+        } else if (keyword(p, line_end, "mtllib")) {
+            chunk.material_libraries.push_back(rest_of_line(p, line_end));
+        }
+        line = line_end + 1;
+    }
+}
+
+void parse_mtl(const std::string& filename, std::vector<ObjMaterial>& materials) {
+    std::ifstream file(filename);
+    if (!file) {
+        std::cerr << "material library not found: " << filename << std::endl;
+        return;
+    }
+    std::string line;
+    while (std::getline(file, line)) {
+        const char* p = line.c_str();
+        const char* end = p + line.size();
+        p = skip_space(p, end);
+        if (keyword(p, end, "newmtl")) {
+            materials.emplace_back();
+            materials.back().name = rest_of_line(p, end);
+            std::fill(materials.back().diffuse, materials.back().diffuse + 3, 0.0f);
+        } else if (materials.empty()) {
+            continue;
+        } else if (keyword(p, end, "Kd")) {
+            std::vector<float> diffuse;
+            read_floats(p, end, 3, diffuse);
+            std::copy(diffuse.begin(), diffuse.end(), materials.back().diffuse);
+        } else if (keyword(p, end, "map_Kd")) {
+            // the rest of the line, file names may contain spaces
+            materials.back().diffuse_texname = rest_of_line(p, end);
+        }
+    }
+}
+}
+
+bool parse_obj(const std::string& filename, ObjData& data) {
+    std::ifstream file(filename, std::ios::binary);
+    if (!file) {
+        std::cerr << "failed to open " << filename << std::endl;
+        return false;
+    }
+    std::stringstream file_stream;
+    file_stream << file.rdbuf();
+    const std::string content = file_stream.str();
+
+    // chunk boundaries are moved to the next line start
+    size_t chunk_count = std::max<size_t>(1, std::min<size_t>(content.size() / MIN_CHUNK_SIZE, 4 * std::max(1u, std::thread::hardware_concurrency())));
+    std::vector<size_t> bounds = { 0 };
+    for (size_t i = 1; i < chunk_count; i++) {
+        size_t pos = content.find('\n', std::max(bounds.back(), i * content.size() / chunk_count));
+        bounds.push_back(pos == std::string::npos ? content.size() : pos + 1);
+    }
+    bounds.push_back(content.size());
+
+    std::vector<Chunk> chunks(chunk_count);
+    parallel_for(chunk_count, [&](size_t i) {
+        parse_chunk(content.data() + bounds[i], content.data() + bounds[i + 1], chunks[i]);
+    });
+
+    std::string directory;
+    size_t slash = filename.find_last_of("/\\");
+    if (slash != std::string::npos)
+        directory = filename.substr(0, slash + 1);
+    std::vector<std::string> libraries;
+    for (const Chunk& chunk : chunks) {
+        for (const std::string& library : chunk.material_libraries) {
+            if (std::find(libraries.begin(), libraries.end(), library) == libraries.end()) {
+                libraries.push_back(library);
+                parse_mtl(directory + library, data.materials);
+            }
+        }
+    }
+    std::unordered_map<std::string, int> material_ids;
+    for (size_t i = 0; i < data.materials.size(); i++) {
+        material_ids.emplace(data.materials[i].name, i);
+    }
+
+    // stitch the chunks in file order
+    std::vector<float>* attributes[3] = { &data.positions, &data.texcoords, &data.normals };
+    const int components[3] = { 3, 2, 3 };
+    int material = -1;
+    bool new_mesh = true;
+    for (Chunk& chunk : chunks) {
+        for (const RelativeIndex& relative : chunk.relative_indices) {
+            long base = attributes[relative.component]->size() / components[relative.component];
+            chunk.segments[relative.segment].corners[relative.position] = base + relative.local;
+        }
+        for (int a = 0; a < 3; a++) {
+            attributes[a]->insert(attributes[a]->end(), chunk.attributes[a].begin(), chunk.attributes[a].end());
+        }
+
+        for (Segment& segment : chunk.segments) {
+            if (segment.start == NEW_MATERIAL) {
+                // exporters repeat usemtl per group, the same material continues the mesh
+                auto it = material_ids.find(segment.material);
+                int id = it == material_ids.end() ? -1 : it->second;
+                new_mesh = new_mesh || id != material;
+                material = id;
+            } else if (segment.start == NEW_OBJECT) {
+                new_mesh = true;
+            }
+            if (segment.corners.empty())
+                continue;
+
+            if (new_mesh) {
+                data.meshes.emplace_back();
+                data.meshes.back().material = material;
+                new_mesh = false;
+            }
+            std::vector<int>& corners = data.meshes.back().corners;
+            corners.insert(corners.end(), segment.corners.begin(), segment.corners.end());
+        }
+    }
+    return true;
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Wavefront OBJ + MTL reader for mesh baking. The text is split into line aligned chunks that are parsed
+// concurrently, then stitched together. Polygons are fanned into triangles. Only what the renderer uses is
+// read: v, vt, vn, f, o/g, usemtl, mtllib and newmtl, Kd, map_Kd
+struct ObjMaterial {
+    std::string name;
+    // relative to the OBJ directory, empty without map_Kd
+    std::string diffuse_texname;
+    float diffuse[3];
+};
+
+// A run of faces of one object with one material, objects using several materials are split
+struct ObjMesh {
+    // index into ObjData::materials, -1 without usemtl or for an unknown material
+    int material = -1;
+    // per triangle corner position, texcoord and normal index, 0 based, -1 when the face has none
+    std::vector<int> corners;
+};
+
+struct ObjData {
+    std::vector<float> positions;
+    std::vector<float> texcoords;
+    std::vector<float> normals;
+    std::vector<ObjMesh> meshes;
+    std::vector<ObjMaterial> materials;
+};
+
+// material libraries are looked up next to the OBJ
+bool parse_obj(const std::string& filename, ObjData& data);
@@ -1,18 +1,57 @@
 #pragma once
 
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 #include <GL/glew.h>
 
+#include "shader_preprocessor.h"
+
+// Typed reference to a uniform of one shader_t, resolve once with shader_t::get_handle
+template <typename T>
+class uniform_handle {
+  public:
+    typedef T value_type;
+
+    uniform_handle() = default;
+
+    // false only for default constructed handles, inactive uniforms still get a slot
+    bool valid() const { return slot_ != -1; }
+
+  private:
+    friend class shader_t;
+    explicit uniform_handle(int slot)
+        : slot_(slot) {}
+
+    int slot_ = -1;
+};
+
+// Uploads through shader_t since the last reset, skipped ones matched the shadow copy of the value
+struct uniform_upload_stats {
+    size_t issued = 0;
+    size_t skipped = 0;
+};
+
 class shader_t
 {
   public:
+    static uniform_upload_stats upload_stats;
+
     shader_t(const std::string& vertex_code_fname, const std::string& fragment_code_fname);
     shader_t(const std::string& vertex_code_fname, const std::string& fragment_code_fname, const std::string& geometry_code_fname);
+    // geometry_code_fname may be empty, defines are injected into every stage (see shader_preprocessor.h)
+    shader_t(const std::string& vertex_code_fname, const std::string& fragment_code_fname, const std::string& geometry_code_fname, const std::vector<std::string>& defines);
+    // vertex only program, the varyings are captured interleaved with transform feedback
+    shader_t(const std::string& vertex_code_fname, const std::vector<std::string>& feedback_varyings);
     ~shader_t();
 
     void use();
+    // rebuilds from the current files, the old program is kept if the new one fails to link.
+    // Handles stay valid and the last uploaded uniform values are set on the new program
+    bool reload();
+    // every file the stages were built from, includes too
+    const std::vector<std::string>& dependencies() const { return dependencies_; }
     template <typename T>
     void set_uniform(const std::string& name, T val);
     template <typename T>
@@ -20,11 +59,53 @@ class shader_t
     template <typename T>
     void set_uniform(const std::string& name, T val1, T val2, T val3);
 
+    template <typename T>
+    uniform_handle<T> get_handle(const std::string& name) {
+        return uniform_handle<T>(get_slot(name));
+    }
+    template <typename T>
+    void set_uniform(uniform_handle<T> handle, typename uniform_handle<T>::value_type val);
+
   private:
     void check_compile_error();
-    void check_linking_error();
-    void compile(const std::string& vertex_code, const std::string& fragment_code, const std::string& geometry_code); 
-    void link();
+    bool check_linking_error();
+    void build();
+    // preprocesses the stage files into a new program_id_, linked from source or taken from program_cache
+    bool create_program();
+    void compile();
+    bool link();
+
+    // locations of active uniforms are read after every link, arrays are also registered without "[0]".
+    // Names keep their slot across relinks
+    void cache_locations();
+    // sets the shadow copies on a freshly linked program, which starts with zeroed uniforms
+    void restore_uniforms();
+    // binds active uniform blocks to the binding points from uniform_blocks.h
+    void bind_uniform_blocks();
+    int get_slot(const std::string& name);
+    GLint get_location(int slot) const { return slot == -1 ? -1 : uniform_locations_[slot]; }
+
+    // compares with the last value uploaded to the slot and remembers the new one,
+    // false means the glUniform call can be skipped
+    bool needs_upload(int slot, const void* data, size_t size);
+
+    std::string vertex_fname_, fragment_fname_, geometry_fname_;
+    std::vector<std::string> defines_;
+    std::vector<std::string> feedback_varyings_;
+
+    ShaderSource vertex_source_, fragment_source_, geometry_source_;
+    std::vector<std::string> dependencies_;
 
     GLuint vertex_id_, fragment_id_, geometry_id_, program_id_;
+
+    std::unordered_map<std::string, int> uniform_slots_;
+    std::vector<GLint> uniform_locations_;
+    std::vector<GLenum> uniform_types_;
+
+    // last uploaded value of every slot, size 0 means unknown. 64 bytes fits a mat4
+    struct uniform_value {
+        size_t size = 0;
+        unsigned char data[64];
+    };
+    std::vector<uniform_value> uniform_values_;
 };
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+// Calls f(i) for every i in [0, count) on up to hardware_concurrency threads, the calling thread included,
+// and returns when all calls are done. f must not throw
+template <typename F>
+void parallel_for(size_t count, F f) {
+    size_t thread_count = std::min<size_t>(count, std::max(1u, std::thread::hardware_concurrency()));
+    std::atomic<size_t> next(0);
+    auto worker = [&]() {
+        for (size_t i = next++; i < count; i = next++) {
+            f(i);
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (size_t t = 1; t < thread_count; t++) {
+        threads.emplace_back(worker);
+    }
+    worker();
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+}
@@ -0,0 +1,57 @@
+#include "shader_permutations.h"
+
+#include <algorithm>
+#include <iostream>
+
+#include "uniform_blocks.h"
+
+ShaderPermutations::ShaderPermutations(const std::string& vertex_fname, const std::string& fragment_fname, std::function<void(shader_t&)> setup)
+    : vertex_fname(vertex_fname)
+    , fragment_fname(fragment_fname)
+    , setup(setup) {
+}
+
+shader_t& ShaderPermutations::get(unsigned features) {
+    auto it = variants.find(features);
+    if (it != variants.end())
+        return *it->second;
+
+    std::cerr << "compiling " << fragment_fname << " variant " << features << std::endl;
+    std::unique_ptr<shader_t> shader(new shader_t(vertex_fname, fragment_fname, "", defines(features)));
+    if (setup) {
+        shader->use();
+        setup(*shader);
+    }
+    return *(variants[features] = std::move(shader));
+}
+
+void ShaderPermutations::for_each_variant(const std::function<void(shader_t&)>& f) {
+    for (auto& variant : variants) {
+        f(*variant.second);
+    }
+}
+
+std::vector<std::string> ShaderPermutations::defines(unsigned features) const {
+    using namespace shader_features;
+
+    // the blocks are sized for DIR_LIGHT_SOURCES / PD_LIGHT_SOURCES, more lights can not be read
+    int dl = std::min<int>((features >> DL_COUNT_SHIFT) & COUNT_MASK, DIR_LIGHT_SOURCES);
+    int pd = std::min<int>((features >> PD_COUNT_SHIFT) & COUNT_MASK, PD_LIGHT_SOURCES);
+
+    std::vector<std::string> result = {
+        "DL_COUNT " + std::to_string(dl),
+        "PD_COUNT " + std::to_string(pd),
+    };
+    if (features & TEX_GAMMA_CORRECT)
+        result.push_back("TEX_GAMMA_CORRECT");
+    if (features & BLEND_GAMMA_CORRECT)
+        result.push_back("BLEND_GAMMA_CORRECT");
+    if (!(features & SHADOWS))
+        result.push_back("NO_SHADOWS");
+    unsigned kernel = (features >> PCF_SHIFT) & COUNT_MASK;
+    if (kernel == PCF_ROTATED_GRID)
+        result.push_back("PCF_ROTATED_GRID");
+    else if (kernel == PCF_POISSON)
+        result.push_back("PCF_POISSON");
+    return result;
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "opengl_shader.h"
+
+// Feature bits of the lit shaders (object.fs, moon.fs, light.fs), every variant is a separate program
+namespace shader_features {
+const unsigned TEX_GAMMA_CORRECT = 1 << 0;
+const unsigned BLEND_GAMMA_CORRECT = 1 << 1;
+const unsigned SHADOWS = 1 << 2;
+// light counts take 2 bits each, up to DIR_LIGHT_SOURCES / PD_LIGHT_SOURCES
+const unsigned DL_COUNT_SHIFT = 3;
+const unsigned PD_COUNT_SHIFT = 5;
+const unsigned COUNT_MASK = 3;
+
+inline unsigned dl_count(unsigned n) { return n << DL_COUNT_SHIFT; }
+inline unsigned pd_count(unsigned n) { return n << PD_COUNT_SHIFT; }
+// shadow filter kernel, 2 bits: one hardware compare (bilinear over 2x2 texels) or several of them
+const unsigned PCF_SHIFT = 7;
+const unsigned PCF_HARDWARE = 0;
+const unsigned PCF_ROTATED_GRID = 1;
+const unsigned PCF_POISSON = 2;
+
+inline unsigned pcf(unsigned kernel) { return kernel << PCF_SHIFT; }
+}
+
+// Variants of one vertex + fragment program keyed by a shader_features mask.
+// A variant is compiled (or taken from the program cache) the first time it is requested
+class ShaderPermutations {
+  public:
+    // setup is called once for every new variant, e.g. to set constant sampler units
+    ShaderPermutations(const std::string& vertex_fname, const std::string& fragment_fname, std::function<void(shader_t&)> setup = nullptr);
+
+    shader_t& get(unsigned features);
+    size_t variant_count() const { return variants.size(); }
+    // compiled variants only
+    void for_each_variant(const std::function<void(shader_t&)>& f);
+
+  private:
+    std::vector<std::string> defines(unsigned features) const;
+
+    std::string vertex_fname;
+    std::string fragment_fname;
+    std::function<void(shader_t&)> setup;
+    std::unordered_map<unsigned, std::unique_ptr<shader_t>> variants;
+};
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "opengl_shader.h"
+#include "shader_permutations.h"
+
+// Reloads shaders when one of the files they were built from (shader_t::dependencies) changes.
+// Changes are collected with inotify and applied in poll(), which is called between frames so a
+// program is never swapped in the middle of a pass. Without inotify (not Linux) poll() does nothing
+class ShaderWatcher {
+  public:
+    ShaderWatcher();
+    ~ShaderWatcher();
+
+    void watch(shader_t& shader);
+    // variants compiled later are watched too
+    void watch(ShaderPermutations& permutations);
+
+    // returns the number of programs that were relinked, failed ones keep the old program
+    int poll();
+
+  private:
+    void watch_files(const shader_t& shader);
+    std::set<std::string> changed_files();
+    int reload_if_changed(shader_t& shader, const std::set<std::string>& changed);
+
+    std::vector<shader_t*> shaders;
+    // with the variant count seen last, new variants are watched in poll()
+    std::vector<std::pair<ShaderPermutations*, size_t>> permutations;
+
+    int inotify_fd = -1;
+    // watch descriptor -> directory with a trailing slash, editors often replace files, so
+    // directories are watched rather than the files
+    std::unordered_map<int, std::string> directories;
+};
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "mapped_file.h"
+
+// Baked texture files in texture_cache/, decoded from JPG/PNG on the first load and memory mapped afterwards.
+// Layout: TextureFileHeader, level table, then the pixels of every level, 16 byte aligned. The table is
+// ordered by layer, face, level; offsets are from the start of the file
+const uint32_t TEXTURE_FILE_MAGIC = 0x31584554; // "TEX1"
+const uint32_t TEXTURE_FILE_VERSION = 1;
+
+enum TextureFileFormat : uint32_t {
+    // tightly packed rows. GL 3.3 core guarantees no RGB block compression, compressed formats go here
+    TEXTURE_FORMAT_RGB8 = 0,
+};
+
+enum TextureFileFlags : uint32_t {
+    // rows bottom up, as GL expects for images shown the right way up
+    TEXTURE_FLIPPED = 1,
+    // 6 faces a layer, +x, -x, +y, -y, +z, -z
+    TEXTURE_CUBEMAP = 2,
+    // full mip chain from generate_mipmaps, otherwise only level 0
+    TEXTURE_MIPMAPPED = 4,
+    // data such as masks rather than colors, the mips average the bytes without the gamma curve
+    TEXTURE_LINEAR = 8,
+};
+
+struct TextureFileHeader {
+    uint32_t magic;
+    uint32_t version;
+    // summed over the source images and the newest time, a file baked from older images is baked again
+    uint64_t source_size;
+    int64_t source_mtime;
+    uint32_t format;
+    uint32_t flags;
+    uint32_t width;
+    uint32_t height;
+    uint32_t level_count;
+    uint32_t face_count;
+    uint32_t layer_count;
+    uint32_t pad;
+};
+
+struct TextureFileLevel {
+    uint32_t width;
+    uint32_t height;
+    uint64_t offset;
+    uint64_t size;
+};
+
+// RGB8 pixels to free with stbi_image_free, nullptr on failure. Flips itself instead of through stb's global
+// flag, so asset loader threads can decode concurrently
+unsigned char* decode_image(const char* filename, int& width, int& height, bool flip_vertically = true);
+
+// "texture_cache/<first source with / replaced>[.flip][.cube][.mips][.linear].tex"
+std::string texture_cache_filename(const std::string& source, uint32_t flags);
+
+// decodes the sources, one a face for every layer, and writes the baked file. Needs no GL so it also runs
+// in texture-baker
+bool bake_texture(const std::vector<std::string>& sources, uint32_t flags, const std::string& texture_filename);
+
+// Read only mapping of a baked file, the levels are uploaded straight from it
+class TextureFile {
+  public:
+    // false if the file is missing, truncated, from another version or older than one of sources.
+    // Missing sources are fine, baked files can be shipped without the images
+    bool open(const std::string& texture_filename, const std::vector<std::string>& sources = {});
+    void close();
+
+    const TextureFileHeader& header() const { return *(const TextureFileHeader*)data; }
+    const TextureFileLevel& level(size_t layer, size_t face, size_t level) const;
+    const unsigned char* pixels(size_t layer, size_t face, size_t level) const;
+
+  private:
+    bool valid() const;
+
+    MappedFile file;
+    // file.data(), while open
+    const unsigned char* data = nullptr;
+};
+
+// opens the baked file of sources from texture_cache/, baking it first if it is missing or stale
+bool open_baked_texture(TextureFile& file, const std::vector<std::string>& sources, uint32_t flags);
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <map>
+#include <memory>
+#include <string>
+
+#include "glconfig.h"
+
+// "a/./b/../c.jpg" and "a\c.jpg" -> "a/c.jpg", so a file reached through different paths is cached once
+std::string canonical_path(const std::string& path);
+
+// Textures shared by key, a canonical path and the TextureFileFlags it is loaded with. A texture stays
+// referenced while any TextureRef to it lives; released ones stay resident for reuse and are deleted least
+// recently released first once the estimated size of all textures exceeds the budget. GL thread only
+class TextureResidency {
+  public:
+    typedef std::pair<std::string, uint32_t> Key;
+
+    TextureResidency(size_t budget_bytes);
+
+    // the cached texture, or a new texture name with created set, which the caller fills and reports to loaded()
+    TextureRef acquire(const Key& key, bool& created);
+    // bytes as estimated by the caller; a texture still loading is never evicted
+    void loaded(const Key& key, size_t bytes);
+    // deletes released textures until the total fits the budget
+    void evict();
+
+    void set_budget(size_t budget_bytes);
+    size_t budget() const { return budget_bytes; }
+    // resident textures, referenced or not, and their estimated size
+    size_t count() const { return state->entries.size(); }
+    size_t bytes() const { return state->bytes; }
+    size_t released_count() const { return state->released.size(); }
+
+  private:
+    struct Entry {
+        GLuint texture = 0;
+        // expired once every TextureRef is gone
+        std::weak_ptr<const GLuint> ref;
+        size_t bytes = 0;
+        bool loading = true;
+        // into State::released, while ref is expired
+        std::list<Key>::iterator released_position;
+    };
+    // shared with the TextureRef deleters, which may run after the residency is gone
+    struct State {
+        std::map<Key, Entry> entries;
+        // least recently released first
+        std::list<Key> released;
+        size_t bytes = 0;
+    };
+
+    TextureRef make_ref(const Key& key, Entry& entry);
+
+    std::shared_ptr<State> state;
+    size_t budget_bytes;
+};
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+#include <GL/glew.h>
+
+#include <glm/glm.hpp>
+
+// must match the defines in assets/light.fs
+const int DIR_LIGHT_SOURCES = 1;
+const int PD_LIGHT_SOURCES = 1;
+// layers of a directional light shadow map, see CascadedShadow
+const int SHADOW_CASCADES = 4;
+
+// std140 mirror of `uniform Camera` in assets/camera.fs
+struct CameraBlock {
+    glm::mat4 u_vp;
+    glm::vec3 u_cam;
+    float pad0;
+    glm::vec3 u_cam_forward;
+    float pad1;
+};
+
+// std140 mirror of `uniform Lights` in assets/light.fs.
+// Array elements are 16 byte aligned in std140, so vec3 and float arrays are stored as vec4
+struct LightsBlock {
+    glm::vec3 background_light;
+    GLint dl_num;
+    GLint pd_num;
+    GLint pad0[3];
+
+    glm::vec4 dl_dir[DIR_LIGHT_SOURCES];
+    glm::vec4 dl_light[DIR_LIGHT_SOURCES];
+    // cascade c of light i at i * SHADOW_CASCADES + c
+    glm::mat4 dl_vp[DIR_LIGHT_SOURCES * SHADOW_CASCADES];
+
+    glm::vec4 pd_dir[PD_LIGHT_SOURCES];
+    glm::vec4 pd_pos[PD_LIGHT_SOURCES];
+    glm::vec4 pd_light[PD_LIGHT_SOURCES];
+    glm::vec4 pd_angle[PD_LIGHT_SOURCES]; // x
+    glm::mat4 pd_vp[PD_LIGHT_SOURCES];
+};
+
+static_assert(offsetof(CameraBlock, u_vp) == 0, "std140 Camera.u_vp");
+static_assert(offsetof(CameraBlock, u_cam) == 64, "std140 Camera.u_cam");
+static_assert(offsetof(CameraBlock, u_cam_forward) == 80, "std140 Camera.u_cam_forward");
+static_assert(sizeof(CameraBlock) == 96, "std140 Camera size");
+
+static_assert(offsetof(LightsBlock, background_light) == 0, "std140 Lights.background_light");
+static_assert(offsetof(LightsBlock, dl_num) == 12, "std140 Lights.dl_num");
+static_assert(offsetof(LightsBlock, pd_num) == 16, "std140 Lights.pd_num");
+static_assert(offsetof(LightsBlock, dl_dir) == 32, "std140 Lights.dl_dir");
+static_assert(offsetof(LightsBlock, dl_light) == 32 + 16 * DIR_LIGHT_SOURCES, "std140 Lights.dl_light");
+static_assert(offsetof(LightsBlock, dl_vp) == 32 + 32 * DIR_LIGHT_SOURCES, "std140 Lights.dl_vp");
+static_assert(offsetof(LightsBlock, pd_dir) == 32 + (32 + 64 * SHADOW_CASCADES) * DIR_LIGHT_SOURCES, "std140 Lights.pd_dir");
+static_assert(offsetof(LightsBlock, pd_pos) == offsetof(LightsBlock, pd_dir) + 16 * PD_LIGHT_SOURCES, "std140 Lights.pd_pos");
+static_assert(offsetof(LightsBlock, pd_light) == offsetof(LightsBlock, pd_dir) + 32 * PD_LIGHT_SOURCES, "std140 Lights.pd_light");
+static_assert(offsetof(LightsBlock, pd_angle) == offsetof(LightsBlock, pd_dir) + 48 * PD_LIGHT_SOURCES, "std140 Lights.pd_angle");
+static_assert(offsetof(LightsBlock, pd_vp) == offsetof(LightsBlock, pd_dir) + 64 * PD_LIGHT_SOURCES, "std140 Lights.pd_vp");
+static_assert(sizeof(LightsBlock) == offsetof(LightsBlock, pd_dir) + 128 * PD_LIGHT_SOURCES, "std140 Lights size");
+
+// Binding point and expected size of a block known by name, NULL for unknown blocks.
+// shader_t binds every active block of a program with this after linking
+struct UniformBlockInfo {
+    const char* name;
+    GLuint binding;
+    size_t size;
+};
+const UniformBlockInfo* find_uniform_block(const std::string& name);
+
+// Buffer bound to the binding point of T for its whole lifetime, value is uploaded once per frame
+template <typename T>
+class UniformBlock {
+  public:
+    explicit UniformBlock(const std::string& name)
+        : value() {
+        const UniformBlockInfo* info = find_uniform_block(name);
+        glGenBuffers(1, &buffer);
+        glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+        glBufferData(GL_UNIFORM_BUFFER, sizeof(T), NULL, GL_DYNAMIC_DRAW);
+        glBindBufferBase(GL_UNIFORM_BUFFER, info->binding, buffer);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    }
+    ~UniformBlock() {
+        glDeleteBuffers(1, &buffer);
+    }
+
+    void upload() {
+        glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(T), &value);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    }
+
+    T value;
+
+  private:
+    GLuint buffer;
+};